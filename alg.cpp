@@ -1,3 +1,6 @@
+#include <cmath>
+#include <complex>
+
 #include "alg.h"
 
 Z choose(int n, int r) {
@@ -407,42 +410,474 @@ std::vector<Z_X> poly_hensel_lift(Z p, int exp, std::vector<Z_X> ai, Z_X c) {
 	return ai_new;
 }
 
-std::vector<Z_X> factor(Z_X a) {
-	// Algorithm 3.5.7
+std::vector<std::pair<Z_X, int>> squarefree_decomposition(Z_X a) {
+	// Yun's algorithm over Z.
+	// Every gcd is made primitive with a positive leading coefficient, so
+	// all of the divisions below are exact and for primitive a with positive
+	// leading coefficient, a = prod a_i^i exactly.
+	
+	std::vector<std::pair<Z_X, int>> result;
+	if (a.degree() < 1)
+		return result;
 	
-	if (a.degree() < 0)
-		return std::vector<Z_X>({a});
+	Z_X a_prime = a.derivative();
+	Z_X a0 = sub_resultant_gcd(a, a_prime);
+	a0 /= a0.content();
+	Z_X b = a.ring_exact_divide(a0).quotient;
+	Z_X c = a_prime.ring_exact_divide(a0).quotient;
+	Z_X d = c - b.derivative();
+	
+	int i = 1;
+	while (b.degree() > 0) {
+		Z_X ai = sub_resultant_gcd(b, d);
+		ai /= ai.content();
+		if (ai.leading() < 0)
+			ai = -ai;
+		b = b.ring_exact_divide(ai).quotient;
+		c = d.ring_exact_divide(ai).quotient;
+		d = c - b.derivative();
+		if (ai.degree() > 0)
+			result.push_back(std::make_pair(ai, i));
+		i++;
+	}
+	
+	return result;
+}
 
-	Z c = a.content();
-	a /= c;
-	Z_X u = a;
-	u = u.ring_exact_divide(sub_resultant_gcd(a, a.derivative())).quotient;
-	if (u[u.degree()] < 0)
-		u = -u;
+std::vector<std::pair<ZN_X, int>> squarefree_decomposition(ZN_X a) {
+	// Squarefree decomposition over Z/pZ.
+	// Yun's algorithm breaks down in characteristic p, since any factor
+	// whose multiplicity is divisible by p vanishes from the derivative.
+	// So we peel off the parts we can see, and whatever is left over is
+	// a p-th power; take its p-th root and recurse.
+	
+	std::vector<std::pair<ZN_X, int>> result;
+	if (a.degree() < 1)
+		return result;
 	
-	// Cast out any factors of x
-	int factors_of_x = 0;
-	if (u[0] == 0) {
-		u >>= 1;
-		Z_X a_temp = a;
-		while (a_temp[0] == 0) {
-			a_temp >>= 1;
-			factors_of_x++;
+	Z p = a.leading().get_base();
+	
+	ZN_X c = std::get<2>(extended_gcd(a, a.derivative()));
+	ZN_X w = a / c;
+	
+	int i = 1;
+	while (w.degree() > 0) {
+		ZN_X y = std::get<2>(extended_gcd(w, c));
+		ZN_X fac = w / y;
+		if (fac.degree() > 0)
+			result.push_back(std::make_pair(fac / ZN_X(fac.leading()), i));
+		w = y;
+		c /= y;
+		i++;
+	}
+	
+	if (c.degree() > 0) {
+		// Now c is a polynomial in x^p, and p is at most deg(c).
+		// Over Z/pZ every constant is its own p-th power, so the
+		// p-th root just keeps every p-th coefficient.
+		int pi = p.get_si();
+		std::vector<ZN> root;
+		for (int j = 0; j <= c.degree(); j += pi)
+			root.push_back(c[j]);
+		std::vector<std::pair<ZN_X, int>> sub = squarefree_decomposition(ZN_X(root));
+		for (int j = 0; j < sub.size(); j++)
+			result.push_back(std::make_pair(sub[j].first, sub[j].second * pi));
+	}
+	
+	return result;
+}
+
+Z factoring_prime(Z_X u) {
+	// Returns the smallest prime p not dividing the leading coefficient of u
+	// such that u stays squarefree mod p.
+	
+	Z p = 1;
+	do
+		mpz_nextprime(p.get_mpz_t(), p.get_mpz_t());
+	while (u[u.degree()] % p == 0 || std::get<2>(extended_gcd(u.convert(to_mod(p)), u.derivative().convert(to_mod(p)))).degree() != 0);
+	
+	return p;
+}
+
+Z_X poly_gcd(Z_X a, Z_X b) {
+	// Primitive gcd with positive leading coefficient
+	Z_X g = sub_resultant_gcd(a, b);
+	if (g.degree() < 0)
+		return g;
+	g /= g.content();
+	if (g.leading() < 0)
+		g = -g;
+	return g;
+}
+
+ZN_X poly_gcd(ZN_X a, ZN_X b) {
+	// Monic gcd
+	ZN_X g = std::get<2>(extended_gcd(a, b));
+	if (g.degree() < 0)
+		return g;
+	return g / ZN_X(g.leading());
+}
+
+int euler_phi(int n) {
+	int phi = n;
+	for (int p = 2; p*p <= n; p++) {
+		if (n % p)
+			continue;
+		phi -= phi / p;
+		while (n % p == 0)
+			n /= p;
+	}
+	if (n > 1)
+		phi -= phi / n;
+	return phi;
+}
+
+Z_X cyclotomic(int n) {
+	// Build Phi_n up one prime at a time from Phi_1 = x - 1, using
+	// Phi_(mp)(x) = Phi_m(x^p) / Phi_m(x) if p does not divide m, and
+	// Phi_(mp)(x) = Phi_m(x^p) if it does.
+	
+	Z_X phi({-1, 1});
+	int rest = n;
+	for (int p = 2; rest > 1; p++) {
+		if (rest % p)
+			continue;
+		Z_X previous = phi;
+		phi = inflate(phi, p).ring_exact_divide(previous).quotient;
+		rest /= p;
+		while (rest % p == 0) {
+			phi = inflate(phi, p);
+			rest /= p;
 		}
 	}
 	
-	// Check if u is constant
-	if (u.degree() < 1) {
-		std::vector<Z_X> result;
+	return phi;
+}
+
+static std::vector<Z_X> factor_squarefree_general(Z_X u);
+
+std::vector<Z_X> binomial_factors(Z_X u) {
+	// If u = a x^n + c, factors it directly: when a = s^e and |c| = t^e for
+	// some e | n, then with y = x^(n/e),
+	// (sy)^e - t^e = prod_(d | e) t^phi(d) Phi_d(sy/t) and
+	// (sy)^e + t^e = prod_(d | 2e, d does not divide e) t^phi(d) Phi_d(sy/t).
+	// Each piece is irreducible in y, so when n = e it is irreducible in x.
+	// Otherwise the pieces go to the general factoring, which must not
+	// look at binomials again: for a single piece (the + case with e a
+	// power of 2) the piece is u itself.
+	// By Capelli's theorem a x^n + c is irreducible unless -c/a is a p-th
+	// power for some prime p | n, or 4 | n and -c/a = -4b^4, and then u is
+	// returned as it is.
+	// Returns nothing if u isn't of this form.
+	// Here u must be primitive with positive leading coefficient.
+	
+	std::vector<Z_X> result;
+	int n = u.degree();
+	if (n < 2 || u[0] == 0)
+		return result;
+	for (int i = 1; i < n; i++)
+		if (u[i] != 0)
+			return result;
+	
+	Z a = u[n];
+	Z c = util<Z>::get_abs(u[0]);
+	bool plus = (u[0] > 0);
+	
+	// Since u is primitive, gcd(a, c) = 1 and -c/a is a p-th power exactly
+	// when a and c are, with p odd in the + case
+	Z s, t;
+	bool reducible = false;
+	int rest = n;
+	for (int p = 2; rest > 1 && !reducible; p++) {
+		if (rest % p)
+			continue;
+		while (rest % p == 0)
+			rest /= p;
+		if ((!plus || p > 2) && mpz_root(s.get_mpz_t(), a.get_mpz_t(), p) && mpz_root(t.get_mpz_t(), c.get_mpz_t(), p))
+			reducible = true;
+	}
+	// and c/a = 4b^4 puts the 4 in c or, when b has an even denominator, in a
+	if (!reducible && plus && n % 4 == 0 && (a % 4 == 0 || c % 4 == 0)) {
+		Z a4 = (a % 4 == 0 ? Z(a / 4) : a), c4 = (c % 4 == 0 ? Z(c / 4) : c);
+		reducible = mpz_root(s.get_mpz_t(), a4.get_mpz_t(), 4) && mpz_root(t.get_mpz_t(), c4.get_mpz_t(), 4);
+	}
+	if (!reducible) {
+		result.push_back(u);
+		return result;
+	}
+	
+	int e;
+	for (e = n; e > 1; e--) {
+		if (n % e)
+			continue;
+		if (mpz_root(s.get_mpz_t(), a.get_mpz_t(), e) && mpz_root(t.get_mpz_t(), c.get_mpz_t(), e))
+			break;
+	}
+	if (e == 1)
+		return result;
+	int m = n / e;
+	
+	for (int d = 1; d <= 2*e; d++) {
+		if (plus && (2*e % d || e % d == 0))
+			continue;
+		if (!plus && e % d)
+			continue;
+		
+		Z_X phi = cyclotomic(d);
+		std::vector<Z> coeffs(phi.degree()*m + 1, 0);
+		for (int i = 0; i <= phi.degree(); i++) {
+			Z si, ti;
+			mpz_pow_ui(si.get_mpz_t(), s.get_mpz_t(), i);
+			mpz_pow_ui(ti.get_mpz_t(), t.get_mpz_t(), phi.degree() - i);
+			coeffs[i*m] = phi[i]*si*ti;
+		}
+		Z_X piece(coeffs);
+		
+		if (m == 1) {
+			result.push_back(piece);
+		}
+		else {
+			std::vector<Z_X> factors = factor_squarefree_general(piece);
+			result.insert(result.end(), factors.begin(), factors.end());
+		}
+	}
+	
+	return result;
+}
+
+std::vector<Z_X> cyclotomic_factors(Z_X u) {
+	// Finds the cyclotomic factors of u with the Graeffe test.
+	// Here u must be primitive and squarefree with u(0) != 0.
+	
+	std::vector<Z_X> result;
+	if (u.degree() < 1)
+		return result;
+	
+	// The gcds over Z are expensive, so first do the whole computation
+	// modulo a largish prime. Reduction mod p can only make these gcds
+	// bigger, so if nothing turns up mod p there's nothing over Z either.
+	Z p = 1 << 20;
+	do
+		mpz_nextprime(p.get_mpz_t(), p.get_mpz_t());
+	while (u.leading() % p == 0);
+	ZN_X u_p = u.convert(to_mod(p));
+	if (odd_cyclotomic_part(u_p).degree() < 1 && even_cyclotomic_part(u_p).degree() < 1)
+		return result;
+	
+	Z_X c = odd_cyclotomic_part(u) * even_cyclotomic_part(u);
+	
+	// Now c is a product of distinct Phi_n; pick them out.
+	// Since phi(n) >= sqrt(n/2), only n <= 2 deg(c)^2 can occur.
+	int max_n = 2*c.degree()*c.degree();
+	for (int n = 1; c.degree() > 0 && n <= max_n; n++) {
+		if (euler_phi(n) > c.degree())
+			continue;
+		Z_X phi = cyclotomic(n);
+		qr_pair<Z_X> qr = c.ring_exact_divide(phi);
+		if (qr.remainder.degree() >= 0)
+			continue;
+		c = qr.quotient;
+		result.push_back(phi);
+	}
+	
+	return result;
+}
+
+Z_X primitive_part(Q_X a) {
+	// Clears denominators, then removes the content and makes the
+	// leading coefficient positive
+	Z common_denominator = 1;
+	for (int i = 0; i <= a.degree(); i++) {
+		if (a[i] != 0)
+			common_denominator = lcm(common_denominator, a[i].get_den());
+	}
+	
+	Z_X a2 = static_cast<Z_X>(a * static_cast<Q>(common_denominator));
+	a2 /= a2.content();
+	if (a2.leading() < 0)
+		a2 = -a2;
+	return a2;
+}
+
+std::vector<Z_X> decomposition_factors(Z_X u) {
+	// If u = g(h) for some g, h of degree at least 2, then every factor of u
+	// is a factor of some g_i(h), where the g_i are the factors of g.
+	// Factoring g and then the smaller g_i(h) is much cheaper than factoring
+	// u directly. Returns nothing if u has no such decomposition or g
+	// doesn't split.
+	// Here u must be primitive and squarefree with positive leading
+	// coefficient.
+	
+	std::vector<Z_X> result;
+	int n = u.degree();
+	
+	std::vector<composition_pair<Q>> candidates;
+	
+	// The trivial case u = g(x^k)
+	int k = deflation(u);
+	if (k > 1 && k < n) {
+		composition_pair<Q> trivial;
+		trivial.outer = static_cast<Q_X>(deflate(u, k));
+		trivial.inner = inflate(Q_X({0, 1}), k);
+		candidates.push_back(trivial);
+	}
+	
+	for (int s = 2; s < n; s++) {
+		if (n % s || s == k)
+			continue;
+		composition_pair<Q> gh = decompose(static_cast<Q_X>(u), s);
+		if (gh.outer.degree() >= 0)
+			candidates.push_back(gh);
+	}
+	
+	for (int i = 0; i < candidates.size(); i++) {
+		std::vector<Q_X> g_factors = factor(candidates[i].outer);
 		
-		result.push_back(Z_X(c));
+		// The last factor is the content
+		if (g_factors.size() < 3)
+			continue;
+		
+		for (int j = 0; j < g_factors.size(); j++) {
+			if (g_factors[j].degree() < 1)
+				continue;
+			std::vector<Z_X> factors = factor_squarefree(primitive_part(g_factors[j].compose(candidates[i].inner)));
+			result.insert(result.end(), factors.begin(), factors.end());
+		}
+		return result;
+	}
+	
+	return result;
+}
+
+std::vector<Z_X> linear_factors(Z_X u) {
+	// Finds the linear factors of u, i.e. its rational roots, by lifting
+	// the roots of u mod p with Newton's method.
+	// Here u must be primitive and squarefree with u(0) != 0.
+	
+	std::vector<Z_X> result;
+	if (u.degree() < 1)
+		return result;
+	if (u.degree() == 1) {
+		result.push_back(u.leading() < 0 ? -u : u);
+		return result;
+	}
 	
-		for (int i = 0; i < factors_of_x; i++)
-			result.insert(result.begin(), Z_X({0, 1}));
+	Z p = factoring_prime(u);
+	ZN_X u_p = u.convert(to_mod(p));
+	
+	// The roots of u mod p are exactly the roots of gcd(u, x^p - x)
+	ZN_X xp = u_p.power_mod(p);
+	ZN_X r = std::get<2>(extended_gcd(u_p, xp - ZN_X({ZN(p, 0), ZN(p, 1)})));
+	if (r.degree() < 1)
+		return result;
+	std::vector<ZN_X> roots_p = berlekamp_auto(r);
+	
+	// A rational root c/b of u has b | u_n and c | u_0, so
+	// u_n * (c/b) is an integer bounded by |u_n u_0|.
+	Z lc = u.leading();
+	Z bound = util<Z>::get_abs(lc)*util<Z>::get_abs(u[0]);
+	int exp = log_bound(p, 2*bound);
+	Z pexp = 1;
+	for (int i = 0; i < exp; i++)
+		pexp *= p;
+	
+	ZN_X u_pexp = u.convert(to_mod(pexp));
+	
+	for (int i = 0; i < roots_p.size(); i++) {
+		if (roots_p[i].degree() != 1)
+			continue;
 		
+		// Newton's method doubles the p-adic precision every step;
+		// u'(x) is a unit mod p since u is squarefree mod p.
+		ZN root_p = -roots_p[i][0] / roots_p[i][1];
+		ZN x(pexp, static_cast<Z>(root_p));
+		for (int precision = 1; precision < exp; precision *= 2) {
+			std::pair<ZN, ZN> v = u_pexp.evaluate_with_derivative(x);
+			x -= v.first / v.second;
+		}
+		
+		// Candidate factor u_n x - u_n root, with symmetric coefficients
+		Z c = static_cast<Z>(x*ZN(pexp, lc));
+		if (2*c > pexp)
+			c -= pexp;
+		Z_X f({-c, lc});
+		f /= f.content();
+		if (f.leading() < 0)
+			f = -f;
+		
+		// Check that f(c/b) = 0 before dividing: b^n u(c/b) with Horner
+		Z b = f[1], a = -f[0];
+		Z value = 0, bpow = 1;
+		for (int j = u.degree(); j >= 0; j--) {
+			value = value*a + u[j]*bpow;
+			bpow *= b;
+		}
+		if (value != 0)
+			continue;
+		
+		result.push_back(f);
+	}
+	
+	return result;
+}
+
+std::vector<Z_X> factor_squarefree(Z_X u) {
+	// Algorithm 3.5.7
+	// Here u must be primitive and squarefree with positive leading
+	// coefficient. The factors are returned primitive with positive
+	// leading coefficients, so their product is exactly u.
+	
+	std::vector<Z_X> result;
+	
+	// Cast out a factor of x
+	if (u[0] == 0) {
+		u >>= 1;
+		result.push_back(Z_X({0, 1}));
+	}
+	
+	// Binomials factor directly through cyclotomic polynomials.
+	// Generically they have lots of factors mod p, which would make the
+	// subset search below explode, and so do cyclotomic factors in general.
+	std::vector<Z_X> binomial = binomial_factors(u);
+	if (binomial.size() > 0) {
+		result.insert(result.end(), binomial.begin(), binomial.end());
+		return result;
+	}
+	
+	std::vector<Z_X> factors = factor_squarefree_general(u);
+	result.insert(result.end(), factors.begin(), factors.end());
+	return result;
+}
+
+static std::vector<Z_X> factor_squarefree_general(Z_X u) {
+	// factor_squarefree without the x and binomial checks, so u(0) != 0
+	std::vector<Z_X> result;
+	
+	// If u = g(h), factor g first and then the pieces g_i(h)
+	std::vector<Z_X> pieces = decomposition_factors(u);
+	if (pieces.size() > 0) {
+		result.insert(result.end(), pieces.begin(), pieces.end());
 		return result;
 	}
 	
+	std::vector<Z_X> cyclotomics = cyclotomic_factors(u);
+	for (int i = 0; i < cyclotomics.size(); i++) {
+		u = u.ring_exact_divide(cyclotomics[i]).quotient;
+		result.push_back(cyclotomics[i]);
+	}
+	
+	// Strip off the rational roots; they're much cheaper to find
+	// p-adically than through the full Hensel lifting and recombination.
+	std::vector<Z_X> linear = linear_factors(u);
+	for (int i = 0; i < linear.size(); i++) {
+		u = u.ring_exact_divide(linear[i]).quotient;
+		result.push_back(linear[i]);
+	}
+	
+	// Check if u is constant
+	if (u.degree() < 1)
+		return result;
+	
 	// If |u_0| < |u_n|, reverse U and note this down for later
 	bool is_reversed = false;
 	if (util<Z>::get_abs(u[0]) < util<Z>::get_abs(u[u.degree()])) {
@@ -452,10 +887,7 @@ std::vector<Z_X> factor(Z_X a) {
 	
 	// std::cout << "u = " << u << std::endl;
 
-	Z p = 1;
-	do
-		mpz_nextprime(p.get_mpz_t(), p.get_mpz_t());
-	while (u[u.degree()] % p == 0 || std::get<2>(extended_gcd(u.convert(to_mod(p)), u.derivative().convert(to_mod(p)))).degree() != 0);
+	Z p = factoring_prime(u);
 
 	std::vector<ZN_X> u_factors = berlekamp_auto(u.convert(to_mod(p)));
 	
@@ -481,8 +913,6 @@ std::vector<Z_X> factor(Z_X a) {
 		// std::cout << "u" << i << " = " << ui[i] << std::endl;
 	}
 	
-	std::vector<Z_X> result;
-	
 	int d = 1;
 	while (2*d <= ui.size()) {
 		
@@ -523,7 +953,7 @@ std::vector<Z_X> factor(Z_X a) {
 			// std::cout << "v = " << v << std::endl;
 			
 			// Cohen recommends checking for divisibility of the constant terms first.
-			if (u[u.degree()]*u[0] % v[0] == 0) {
+			if (v[0] != 0 && u[u.degree()]*u[0] % v[0] == 0) {
 
 				qr_pair<Z_X> test_qr = (u*u[u.degree()]).pseudo_divide(v);
 				Z modbase = 1;
@@ -532,28 +962,14 @@ std::vector<Z_X> factor(Z_X a) {
 				if (test_qr.remainder.degree() < 0 && test_qr.quotient.content() % modbase == 0) {
 					// We did it! We found a factor!
 					Z_X f = v / v.content();
+					u = u.ring_exact_divide(f).quotient;
 					
 					if (is_reversed)
 						f = f.reverse();
+					if (f.leading() < 0)
+						f = -f;
+					result.push_back(f);
 
-					Z_X a_temp = a;
-					while (true) {
-						qr_pair<Z_X> qr = a_temp.pseudo_divide(f);
-						modbase = 1;
-						for (int i = 0; i < a_temp.degree() - f.degree() + 1; i++)
-							modbase *= f[f.degree()];
-						if (qr.remainder.degree() >= 0)
-							break;
-						if (qr.quotient.content() % modbase != 0)
-							break;
-						a_temp = a_temp.ring_exact_divide(f).quotient;
-						result.push_back(f);
-					}
-					
-					if (is_reversed)
-						f = f.reverse();
-
-					u = u.ring_exact_divide(f).quotient;
 					if (2*d <= ui.size()) {
 						for (int i = 0; i < combination.size(); i++)
 							ui.erase(ui.begin() + combination[i] - i);
@@ -582,7 +998,7 @@ std::vector<Z_X> factor(Z_X a) {
 				if (start_point < 0)
 					break;
 				combination[start_point]++;
-				for (int i = start_point + 1; i < ui.size(); i++)
+				for (int i = start_point + 1; i < d; i++)
 					combination[i] = combination[i-1] + 1;
 			}
 			if (start_point < 0)
@@ -596,26 +1012,42 @@ std::vector<Z_X> factor(Z_X a) {
 		
 	}
 	
-	Z_X f = u / u.content();
-	Z_X a_temp = a;
-	if (is_reversed)
-		f = f.reverse();
-	while (true) {
-		qr_pair<Z_X> qr = a_temp.pseudo_divide(f);
-		Z modbase = 1;
-		for (int i = 0; i < a_temp.degree() - f.degree() + 1; i++)
-			modbase *= f[f.degree()];
-		if (qr.remainder.degree() >= 0)
-			break;
-		if (qr.quotient.content() % modbase != 0)
-			break;
-		a_temp = a_temp.ring_exact_divide(f).quotient;
+	if (u.degree() >= 1) {
+		Z_X f = u / u.content();
+		if (is_reversed)
+			f = f.reverse();
+		if (f.leading() < 0)
+			f = -f;
 		result.push_back(f);
 	}
-	result.push_back(Z_X(c));
 	
-	for (int i = 0; i < factors_of_x; i++)
-		result.insert(result.begin(), Z_X({0, 1}));
+	return result;
+}
+
+std::vector<Z_X> factor(Z_X a) {
+	// Split a into its content and squarefree parts with Yun's algorithm,
+	// then factor each part separately. The multiplicities come straight
+	// out of the decomposition.
+	
+	if (a.degree() < 0)
+		return std::vector<Z_X>({a});
+
+	Z c = a.content();
+	a /= c;
+	if (a.leading() < 0) {
+		a = -a;
+		c = -c;
+	}
+	
+	std::vector<Z_X> result;
+	std::vector<std::pair<Z_X, int>> parts = squarefree_decomposition(a);
+	for (int i = 0; i < parts.size(); i++) {
+		std::vector<Z_X> factors = factor_squarefree(parts[i].first);
+		for (int j = 0; j < factors.size(); j++)
+			for (int e = 0; e < parts[i].second; e++)
+				result.push_back(factors[j]);
+	}
+	result.push_back(Z_X(c));
 	
 	return result;
 }
@@ -638,67 +1070,1303 @@ std::vector<Q_X> factor(Q_X a) {
 	return result;
 }
 
-std::vector<poly<numberfield>> factor(poly<numberfield> a) {
-	if (a.degree() < 0)
-		return std::vector<poly<numberfield>>({a});
+// Word-sized arithmetic modulo a prime p < 2^32, used by trager_norm
+
+static unsigned long long pow_mod(unsigned long long a, unsigned long long e, unsigned long long p) {
+	unsigned long long result = 1;
+	a %= p;
+	while (e) {
+		if (e & 1)
+			result = result * a % p;
+		a = a * a % p;
+		e >>= 1;
+	}
+	return result;
+}
+
+static unsigned long long inv_mod(unsigned long long a, unsigned long long p) {
+	return pow_mod(a, p - 2, p);
+}
+
+static void trim(std::vector<unsigned long long> &a) {
+	while (!a.empty() && a.back() == 0)
+		a.pop_back();
+}
+
+static unsigned long long word_resultant(std::vector<unsigned long long> a, std::vector<unsigned long long> b, unsigned long long p) {
+	// Euclid's algorithm over Z/p, using
+	// Res(A, B) = (-1)^(deg A deg B) lc(B)^(deg A - deg R) Res(B, R)
+	// for R = A mod B, and Res(A, c) = c^(deg A) for a constant c.
+	
+	trim(a);
+	trim(b);
+	if (a.empty() || b.empty())
+		return 0;
+	
+	unsigned long long result = 1;
+	while (b.size() > 1) {
+		int da = a.size() - 1, db = b.size() - 1;
+		unsigned long long lc_inv = inv_mod(b.back(), p);
+		for (int i = da; i >= db; i--) {
+			unsigned long long q = a[i] * lc_inv % p;
+			if (q == 0)
+				continue;
+			for (int j = 0; j <= db; j++)
+				a[i - db + j] = (a[i - db + j] + p - q * b[j] % p) % p;
+		}
+		if (da >= db)
+			a.resize(db);
+		trim(a);
+		if (a.empty())
+			return 0;
+		
+		int dr = a.size() - 1;
+		if (da % 2 && db % 2)
+			result = (p - result) % p;
+		result = result * pow_mod(b.back(), da - dr, p) % p;
+		std::swap(a, b);
+	}
 	
-	if (a[a.degree()].is_poly()) {
-		std::vector<polymod<numberfield>> coeffs;
-		for (int i = 0; i <= a.degree(); i++)
-			coeffs.push_back(a[i].get_poly_value());
-		std::vector<poly<polymod<numberfield>>> factors = factor(poly<polymod<numberfield>>(coeffs));
-		std::vector<poly<numberfield>> result;
-		for (int i = 0; i < factors.size(); i++)
-			result.push_back((poly<numberfield>)factors[i]);
-		return result;
+	return result * pow_mod(b[0], a.size() - 1, p) % p;
+}
+
+static std::vector<unsigned long long> word_interpolate(std::vector<unsigned long long> xs, std::vector<unsigned long long> vs, unsigned long long p) {
+	// Newton interpolation over Z/p: the unique polynomial of degree
+	// < xs.size() taking the values vs at the distinct points xs
+	
+	int d = xs.size() - 1;
+	for (int j = 1; j <= d; j++) {
+		for (int i = d; i >= j; i--)
+			vs[i] = (vs[i] + p - vs[i - 1]) % p * inv_mod((xs[i] + p - xs[i - j]) % p, p) % p;
 	}
 	
-	std::vector<Q> coeffs;
-	for (int i = 0; i <= a.degree(); i++)
-		coeffs.push_back(a[i].get_rational_value());
-	std::vector<poly<Q>> factors = factor(poly<Q>(coeffs));
-	std::vector<poly<numberfield>> result;
-	for (int i = 0; i < factors.size(); i++)
-		result.push_back((poly<numberfield>)factors[i]);
+	std::vector<unsigned long long> result(1, vs[d]);
+	for (int i = d - 1; i >= 0; i--) {
+		// result = result*(x - xs[i]) + vs[i]
+		result.push_back(0);
+		for (int j = result.size() - 1; j > 0; j--)
+			result[j] = (result[j - 1] + p - result[j] * xs[i] % p) % p;
+		result[0] = (vs[i] + p - result[0] * xs[i] % p) % p;
+	}
 	return result;
 }
 
-std::vector<C> find_complex_roots(Q_X p_q, int precision) {
-	// Algorithm 3.6.6
-	
-	R prec_limit = 1;
-	for (int i = 0; i < precision; i++)
-		prec_limit /= 10;
+static std::vector<unsigned long long> word_gcd(std::vector<unsigned long long> a, std::vector<unsigned long long> b, unsigned long long p) {
+	// Euclid's algorithm over Z/p; the result isn't normalized
+	
+	trim(a);
+	trim(b);
+	while (!b.empty()) {
+		int da = a.size() - 1, db = b.size() - 1;
+		unsigned long long lc_inv = inv_mod(b.back(), p);
+		for (int i = da; i >= db; i--) {
+			unsigned long long q = a[i] * lc_inv % p;
+			if (q == 0)
+				continue;
+			for (int j = 0; j <= db; j++)
+				a[i - db + j] = (a[i - db + j] + p - q * b[j] % p) % p;
+		}
+		if (da >= db)
+			a.resize(db);
+		trim(a);
+		std::swap(a, b);
+	}
+	return a;
+}
+
+struct trager_norm_data {
+	// T(y) and G(x, y) = u(x - ky, y) with denominators cleared, so that
+	// the norm is Res_y(t, g) / (t_den^dg g_den^m), where m = deg t and
+	// dg = deg_y g. The norm has degree at most d in x.
+	Z_X t;
+	std::vector<Z_X> g;
+	Z t_den, g_den;
+	int m, dg, d;
+};
+
+static trager_norm_data prepare_trager_norm(poly<polymod<Q>> u, Q k) {
+	trager_norm_data data;
+	
+	Q_X t = u.leading().get_base();
+	std::vector<Q_X> gs;
+	for (int i = 0; i <= u.degree(); i++)
+		gs.push_back(u[i].get_value());
+	poly<Q_X> g(gs);
+	poly<Q_X> gxkyy = switch_variables(g.taylor_shift(Q_X({Q(0), -k})));
+	
+	data.m = t.degree();
+	data.dg = gxkyy.degree();
+	data.t_den = 1;
+	data.g_den = 1;
+	for (int i = 0; i <= data.m; i++) {
+		if (t[i] != 0)
+			data.t_den = lcm(data.t_den, t[i].get_den());
+	}
+	for (int l = 0; l <= data.dg; l++) {
+		for (int i = 0; i <= gxkyy[l].degree(); i++) {
+			if (gxkyy[l][i] != 0)
+				data.g_den = lcm(data.g_den, gxkyy[l][i].get_den());
+		}
+	}
 	
-	// Note that unlike 3.6.6, here we do not assume p to be squarefree
-	p_q = p_q / sub_resultant_gcd(p_q, p_q.derivative());
-	std::vector<C> p_coeffs;
-	for (int i = 0; i <= p_q.degree(); i++)
-		p_coeffs.push_back((C)p_q[i]);
+	data.t = static_cast<Z_X>(t * static_cast<Q>(data.t_den));
+	int dx = 0;
+	for (int l = 0; l <= data.dg; l++) {
+		data.g.push_back(static_cast<Z_X>(gxkyy[l] * static_cast<Q>(data.g_den)));
+		dx = std::max(dx, data.g[l].degree());
+	}
+	// Only the m rows of the Sylvester matrix coming from G involve x
+	data.d = data.m * dx;
 	
-	C_X p(p_coeffs);
-	C_X q = p;
-	C_X p_prime = p.derivative();
-	C_X q_prime = p_prime;
-	int n = p.degree();
+	return data;
+}
+
+static bool trager_norm_prime(const trager_norm_data &data, unsigned long long p) {
+	// Whether word_trager_norm can use p: it must not divide the leading
+	// coefficient of t, and the leading coefficient of g in y must not
+	// vanish identically mod p, or no evaluation point would keep the
+	// degree in y.
+	if (mpz_fdiv_ui(data.t[data.m].get_mpz_t(), p) == 0)
+		return false;
+	const Z_X &g_lead = data.g[data.dg];
+	for (int i = 0; i <= g_lead.degree(); i++)
+		if (mpz_fdiv_ui(g_lead[i].get_mpz_t(), p) != 0)
+			return true;
+	return false;
+}
+
+static std::vector<unsigned long long> word_trager_norm(const trager_norm_data &data, unsigned long long p) {
+	// Res_y(t, g) mod p, evaluated at points where the degree in y doesn't
+	// drop and then interpolated. p must pass trager_norm_prime; then the
+	// leading coefficient of g has at most deg_x g roots mod p, far fewer
+	// than p, so enough points are found.
+	
+	std::vector<unsigned long long> t_p;
+	for (int i = 0; i <= data.m; i++)
+		t_p.push_back(mpz_fdiv_ui(data.t[i].get_mpz_t(), p));
+	std::vector<std::vector<unsigned long long>> g_p(data.dg + 1);
+	for (int l = 0; l <= data.dg; l++) {
+		for (int i = 0; i <= data.g[l].degree(); i++)
+			g_p[l].push_back(mpz_fdiv_ui(data.g[l][i].get_mpz_t(), p));
+	}
 	
-	std::vector<C> roots;
+	std::vector<unsigned long long> xs, vs;
+	for (unsigned long long x = 0; xs.size() <= data.d; x++) {
+		std::vector<unsigned long long> gx(data.dg + 1, 0);
+		for (int l = 0; l <= data.dg; l++) {
+			for (int i = g_p[l].size() - 1; i >= 0; i--)
+				gx[l] = (gx[l] * x + g_p[l][i]) % p;
+		}
+		if (gx[data.dg] == 0)
+			continue;
+		xs.push_back(x);
+		vs.push_back(word_resultant(t_p, gx, p));
+	}
+	return word_interpolate(xs, vs, p);
+}
+
+Q_X trager_norm(poly<polymod<Q>> u, Q k) {
+	// Res_y(T(y), G(x, y)) for G(x, y) = u(x - ky, y), computed modulo
+	// word-sized primes at enough values of x, then recovered by
+	// interpolation and the Chinese remainder theorem. This gives the same
+	// polynomial as the generic version without the coefficient explosion
+	// of subresultants over Q[x][y].
+	
+	trager_norm_data data = prepare_trager_norm(u, k);
+	if (data.m < 0 || data.dg < 0)
+		return Q_X();
+	
+	// Each entry of the Sylvester matrix is a polynomial in x, so expanding
+	// the determinant bounds every coefficient of the resultant by the
+	// product over the rows of the sums of the l1 norms of the entries.
+	Z t_norm = 0, g_norm = 0;
+	for (int i = 0; i <= data.m; i++)
+		t_norm += abs(data.t[i]);
+	for (int l = 0; l <= data.dg; l++) {
+		for (int i = 0; i <= data.g[l].degree(); i++)
+			g_norm += abs(data.g[l][i]);
+	}
+	Z bound = 2 * util<Z>::get_pow(t_norm, data.dg) * util<Z>::get_pow(g_norm, data.m);
 	
-	while (n > 0) {
-		C x(1.3, 0.314159);
-		C v = q.evaluate(x);
-		R m = v.norm();
+	std::vector<Z> n(data.d + 1, 0);
+	Z modulus = 1;
+	Z p = 1;
+	p <<= 31;
+	while (modulus <= bound) {
+		mpz_nextprime(p.get_mpz_t(), p.get_mpz_t());
+		unsigned long long pw = p.get_ui();
+		if (!trager_norm_prime(data, pw))
+			continue;
 		
-		while (true) {
-			int c = 0;
-			C dx = v / q_prime.evaluate(x);
-			if (sqrt(dx.norm()) < prec_limit)
-				break;
-			
+		std::vector<unsigned long long> n_p = word_trager_norm(data, pw);
+		
+		// Chinese remainder theorem
+		unsigned long long modulus_inv = inv_mod(mpz_fdiv_ui(modulus.get_mpz_t(), pw), pw);
+		for (int i = 0; i <= data.d; i++) {
+			unsigned long long r = mpz_fdiv_ui(n[i].get_mpz_t(), pw);
+			n[i] += modulus * static_cast<Z>(static_cast<unsigned long>((n_p[i] + pw - r) % pw * modulus_inv % pw));
+		}
+		modulus *= p;
+	}
+	
+	Q scale = static_cast<Q>(util<Z>::get_pow(data.t_den, data.dg) * util<Z>::get_pow(data.g_den, data.m));
+	std::vector<Q> result;
+	for (int i = 0; i <= data.d; i++) {
+		if (2 * n[i] > modulus)
+			n[i] -= modulus;
+		result.push_back(static_cast<Q>(n[i]) / scale);
+	}
+	return Q_X(result);
+}
+
+int norm_squarefree_hint(poly<polymod<Q>> u, Q k) {
+	// Checks trager_norm(u, k) for squarefreeness modulo a couple of word
+	// primes, which is far cheaper than computing it exactly.
+	// If the norm has full degree and is squarefree mod p, it's squarefree,
+	// so this returns 1. If it has a repeated factor mod every prime tried,
+	// it almost certainly has one over Q as well, so this returns 0;
+	// wrongly rejecting k only costs trying the next one. Otherwise it
+	// returns -1.
+	
+	trager_norm_data data = prepare_trager_norm(u, k);
+	if (data.m < 0 || data.dg < 0)
+		return -1;
+	
+	int tries = 2;
+	Z p = 1;
+	p <<= 30;
+	while (tries > 0) {
+		mpz_nextprime(p.get_mpz_t(), p.get_mpz_t());
+		unsigned long long pw = p.get_ui();
+		if (!trager_norm_prime(data, pw))
+			continue;
+		tries--;
+		
+		std::vector<unsigned long long> n_p = word_trager_norm(data, pw);
+		trim(n_p);
+		if (n_p.empty())
+			return -1;
+		
+		std::vector<unsigned long long> n_p_prime;
+		for (int i = 1; i < n_p.size(); i++)
+			n_p_prime.push_back(n_p[i] * i % pw);
+		if (word_gcd(n_p, n_p_prime, pw).size() == 1)
+			return n_p.size() == data.d + 1 ? 1 : -1;
+	}
+	
+	return 0;
+}
+
+bool rational_reconstruction(Z a, Z m, Q &result) {
+	// Finds r/s congruent to a mod m with |r|, |s| <= sqrt(m/2), using the
+	// half-extended Euclidean algorithm. Such a fraction is unique if it
+	// exists.
+	
+	Z bound = sqrt(m / 2);
+	Z r0 = m, r1 = a % m, s0 = 0, s1 = 1;
+	if (r1 < 0)
+		r1 += m;
+	while (r1 > bound) {
+		Z q = r0 / r1;
+		Z temp = r0 - q*r1;
+		r0 = r1;
+		r1 = temp;
+		temp = s0 - q*s1;
+		s0 = s1;
+		s1 = temp;
+	}
+	
+	if (s1 == 0 || abs(s1) > bound || gcd(r1, s1) != 1)
+		return false;
+	result = Q(r1, s1);
+	result.canonicalize();
+	return true;
+}
+
+static std::vector<unsigned long long> word_divide(std::vector<unsigned long long> &a, const std::vector<unsigned long long> &b, unsigned long long p) {
+	// Replaces a by a mod b over Z/p and returns the quotient
+	
+	int da = a.size() - 1, db = b.size() - 1;
+	if (da < db)
+		return std::vector<unsigned long long>();
+	
+	std::vector<unsigned long long> q(da - db + 1, 0);
+	unsigned long long lc_inv = inv_mod(b.back(), p);
+	for (int i = da; i >= db; i--) {
+		q[i - db] = a[i] * lc_inv % p;
+		if (q[i - db] == 0)
+			continue;
+		for (int j = 0; j <= db; j++)
+			a[i - db + j] = (a[i - db + j] + p - q[i - db] * b[j] % p) % p;
+	}
+	a.resize(db);
+	trim(a);
+	return q;
+}
+
+static std::vector<unsigned long long> word_mul_mod(const std::vector<unsigned long long> &a, const std::vector<unsigned long long> &b, const std::vector<unsigned long long> &t, unsigned long long p) {
+	// a*b mod t over Z/p
+	
+	if (a.empty() || b.empty())
+		return std::vector<unsigned long long>();
+	std::vector<unsigned long long> c(a.size() + b.size() - 1, 0);
+	for (int i = 0; i < a.size(); i++) {
+		for (int j = 0; j < b.size(); j++)
+			c[i + j] = (c[i + j] + a[i] * b[j]) % p;
+	}
+	trim(c);
+	word_divide(c, t, p);
+	return c;
+}
+
+static bool word_inverse(const std::vector<unsigned long long> &a, const std::vector<unsigned long long> &t, unsigned long long p, std::vector<unsigned long long> &inverse) {
+	// Inverts a mod t over Z/p with the extended Euclidean algorithm.
+	// Fails if a is a zero divisor, which can happen since t need not be
+	// irreducible mod p.
+	
+	std::vector<unsigned long long> r0 = t, r1 = a, s0, s1(1, 1);
+	while (!r1.empty()) {
+		std::vector<unsigned long long> q = word_divide(r0, r1, p);
+		std::swap(r0, r1);
+		std::vector<unsigned long long> qs = word_mul_mod(q, s1, t, p);
+		qs.resize(std::max(qs.size(), s0.size()), 0);
+		for (int i = 0; i < s0.size(); i++)
+			qs[i] = (p - qs[i] + s0[i]) % p;
+		for (int i = s0.size(); i < qs.size(); i++)
+			qs[i] = (p - qs[i]) % p;
+		trim(qs);
+		s0 = s1;
+		s1 = qs;
+	}
+	
+	if (r0.size() != 1)
+		return false;
+	unsigned long long c = inv_mod(r0[0], p);
+	inverse = s0;
+	for (int i = 0; i < inverse.size(); i++)
+		inverse[i] = inverse[i] * c % p;
+	return true;
+}
+
+static bool word_field_gcd(std::vector<std::vector<unsigned long long>> a, std::vector<std::vector<unsigned long long>> b, const std::vector<unsigned long long> &t, unsigned long long p, std::vector<std::vector<unsigned long long>> &result) {
+	// Monic gcd over ((Z/p)[y]/(t))[x] by Euclid's algorithm. This ring is
+	// a product of fields when t is squarefree mod p, but fails whenever a
+	// leading coefficient turns out not to be invertible.
+	
+	while (!a.empty() && a.back().empty())
+		a.pop_back();
+	while (!b.empty() && b.back().empty())
+		b.pop_back();
+	
+	while (!b.empty()) {
+		std::vector<unsigned long long> lc_inv;
+		if (!word_inverse(b.back(), t, p, lc_inv))
+			return false;
+		int da = a.size() - 1, db = b.size() - 1;
+		for (int i = da; i >= db; i--) {
+			std::vector<unsigned long long> q = word_mul_mod(a[i], lc_inv, t, p);
+			if (q.empty())
+				continue;
+			for (int j = 0; j <= db; j++) {
+				std::vector<unsigned long long> qb = word_mul_mod(q, b[j], t, p);
+				std::vector<unsigned long long> &c = a[i - db + j];
+				c.resize(std::max(c.size(), qb.size()), 0);
+				for (int k = 0; k < qb.size(); k++)
+					c[k] = (c[k] + p - qb[k]) % p;
+				trim(c);
+			}
+		}
+		if (da >= db)
+			a.resize(db);
+		while (!a.empty() && a.back().empty())
+			a.pop_back();
+		std::swap(a, b);
+	}
+	
+	if (a.empty()) {
+		result = a;
+		return true;
+	}
+	std::vector<unsigned long long> lc_inv;
+	if (!word_inverse(a.back(), t, p, lc_inv))
+		return false;
+	for (int i = 0; i < a.size(); i++)
+		a[i] = word_mul_mod(a[i], lc_inv, t, p);
+	result = a;
+	return true;
+}
+
+static std::vector<Z_X> integral_coefficients(poly<polymod<Q>> a) {
+	// The coefficients of a as polynomials in the generator, all scaled by
+	// one common denominator
+	
+	std::vector<Q_X> values;
+	Z common_denominator = 1;
+	for (int i = 0; i <= a.degree(); i++) {
+		values.push_back(a[i].get_value());
+		for (int j = 0; j <= values[i].degree(); j++)
+			common_denominator = lcm(common_denominator, values[i][j].get_den());
+	}
+	
+	std::vector<Z_X> result;
+	for (int i = 0; i <= a.degree(); i++)
+		result.push_back(static_cast<Z_X>(values[i] * static_cast<Q>(common_denominator)));
+	return result;
+}
+
+static std::vector<std::vector<unsigned long long>> word_reduce(const std::vector<Z_X> &a, const std::vector<unsigned long long> &t, unsigned long long p) {
+	std::vector<std::vector<unsigned long long>> result;
+	for (int i = 0; i < a.size(); i++) {
+		std::vector<unsigned long long> c;
+		for (int j = 0; j <= a[i].degree(); j++)
+			c.push_back(mpz_fdiv_ui(a[i][j].get_mpz_t(), p));
+		trim(c);
+		word_divide(c, t, p);
+		result.push_back(c);
+	}
+	while (!result.empty() && result.back().empty())
+		result.pop_back();
+	return result;
+}
+
+poly<polymod<Q>> modular_gcd(poly<polymod<Q>> a, poly<polymod<Q>> b) {
+	// Encarnacion's modular gcd over Q(alpha) = Q[y]/(T).
+	// Modulo a prime p for which T stays squarefree, the gcd is computed in
+	// ((Z/p)[y]/(T))[x], and the images for primes giving the same degree
+	// are combined with the Chinese remainder theorem. Primes giving a
+	// larger degree are unlucky and get discarded. Once rational
+	// reconstruction of the coefficients stops changing, the candidate is
+	// checked by trial division. The result is monic.
+	// If T isn't irreducible, Q[y]/(T) isn't a field and this may never
+	// succeed, so after enough primes this falls back to subresultants.
+	
+	if (a.degree() < 0) {
+		if (b.degree() < 0)
+			return b;
+		return b / b.leading();
+	}
+	if (b.degree() < 0)
+		return a / a.leading();
+	if (a.degree() == 0 || b.degree() == 0)
+		return poly<polymod<Q>>(util<polymod<Q>>::one(a.leading()));
+	
+	Q_X t = a.leading().get_base();
+	Z_X t_z = primitive_part(t);
+	int m = t_z.degree();
+	std::vector<Z_X> a_z = integral_coefficients(a);
+	std::vector<Z_X> b_z = integral_coefficients(b);
+	
+	int degree = std::min(a.degree(), b.degree()) + 1;
+	std::vector<std::vector<Z>> g;
+	Z modulus = 1;
+	poly<polymod<Q>> candidate;
+	bool have_candidate = false;
+	
+	Z p = 1;
+	p <<= 31;
+	for (int tries = 0; tries < modular_gcd_max_primes; tries++) {
+		mpz_nextprime(p.get_mpz_t(), p.get_mpz_t());
+		unsigned long long pw = p.get_ui();
+		if (mpz_fdiv_ui(t_z[m].get_mpz_t(), pw) == 0)
+			continue;
+		
+		std::vector<unsigned long long> t_p, t_p_prime;
+		for (int i = 0; i <= m; i++)
+			t_p.push_back(mpz_fdiv_ui(t_z[i].get_mpz_t(), pw));
+		unsigned long long lc_inv = inv_mod(t_p[m], pw);
+		for (int i = 0; i <= m; i++)
+			t_p[i] = t_p[i] * lc_inv % pw;
+		for (int i = 1; i <= m; i++)
+			t_p_prime.push_back(t_p[i] * i % pw);
+		if (word_gcd(t_p, t_p_prime, pw).size() != 1)
+			continue;
+		
+		std::vector<std::vector<unsigned long long>> a_p = word_reduce(a_z, t_p, pw);
+		std::vector<std::vector<unsigned long long>> b_p = word_reduce(b_z, t_p, pw);
+		if (a_p.size() != a_z.size() || b_p.size() != b_z.size())
+			continue;
+		
+		std::vector<std::vector<unsigned long long>> g_p;
+		if (!word_field_gcd(a_p, b_p, t_p, pw, g_p))
+			continue;
+		int d = g_p.size() - 1;
+		if (d == 0)
+			return poly<polymod<Q>>(util<polymod<Q>>::one(a.leading()));
+		if (d > degree)
+			continue;
+		if (d < degree) {
+			degree = d;
+			g = std::vector<std::vector<Z>>(d + 1, std::vector<Z>(m, 0));
+			modulus = 1;
+			have_candidate = false;
+		}
+		
+		// Chinese remainder theorem
+		unsigned long long modulus_inv = inv_mod(mpz_fdiv_ui(modulus.get_mpz_t(), pw), pw);
+		for (int i = 0; i <= d; i++) {
+			g_p[i].resize(m, 0);
+			for (int j = 0; j < m; j++) {
+				unsigned long long r = mpz_fdiv_ui(g[i][j].get_mpz_t(), pw);
+				g[i][j] += modulus * static_cast<Z>(static_cast<unsigned long>((g_p[i][j] + pw - r) % pw * modulus_inv % pw));
+			}
+		}
+		modulus *= p;
+		
+		std::vector<polymod<Q>> coeffs;
+		bool reconstructed = true;
+		for (int i = 0; i <= d && reconstructed; i++) {
+			std::vector<Q> c(m);
+			for (int j = 0; j < m && reconstructed; j++)
+				reconstructed = rational_reconstruction(g[i][j], modulus, c[j]);
+			coeffs.push_back(polymod<Q>(a.leading(), Q_X(c)));
+		}
+		if (!reconstructed)
+			continue;
+		
+		poly<polymod<Q>> h(coeffs);
+		if (have_candidate && h == candidate) {
+			if (a.divide(h).remainder.degree() < 0 && b.divide(h).remainder.degree() < 0)
+				return h;
+		}
+		candidate = h;
+		have_candidate = true;
+	}
+	
+	poly<polymod<Q>> h = sub_resultant_gcd(a, b);
+	return h / h.leading();
+}
+
+poly<polymod<Q>> poly_gcd(poly<polymod<Q>> a, poly<polymod<Q>> b) {
+	return modular_gcd(a, b);
+}
+
+std::vector<std::vector<Z>> lll_reduce(std::vector<std::vector<Z>> b) {
+	// Algorithm 2.6.7, the all-integer version of LLL with the constant
+	// 3/4, which avoids the rational arithmetic of Algorithm 2.6.3. The
+	// rows of b must be linearly independent. Indices into d and lambda
+	// start at 1 as in the book, with d_0 = 1.
+	
+	int n = b.size();
+	if (n == 0)
+		return b;
+	int dim = b[0].size();
+	
+	std::vector<Z> d(n + 1, 0);
+	std::vector<std::vector<Z>> lambda(n + 1, std::vector<Z>(n + 1, 0));
+	
+	auto dot = [dim](const std::vector<Z> &x, const std::vector<Z> &y) {
+		Z result = 0;
+		for (int i = 0; i < dim; i++)
+			result += x[i]*y[i];
+		return result;
+	};
+	auto red = [&](int k, int l) {
+		if (2*abs(lambda[k][l]) <= d[l])
+			return;
+		// q is the nearest integer to lambda_kl / d_l
+		Z q;
+		Z num = 2*lambda[k][l] + d[l];
+		Z den = 2*d[l];
+		mpz_fdiv_q(q.get_mpz_t(), num.get_mpz_t(), den.get_mpz_t());
+		for (int i = 0; i < dim; i++)
+			b[k - 1][i] -= q*b[l - 1][i];
+		lambda[k][l] -= q*d[l];
+		for (int i = 1; i < l; i++)
+			lambda[k][i] -= q*lambda[l][i];
+	};
+	auto swap = [&](int k, int k_max) {
+		std::swap(b[k - 1], b[k - 2]);
+		for (int j = 1; j < k - 1; j++)
+			std::swap(lambda[k][j], lambda[k - 1][j]);
+		Z l = lambda[k][k - 1];
+		Z big_b = (d[k - 2]*d[k] + l*l) / d[k - 1];
+		for (int i = k + 1; i <= k_max; i++) {
+			Z t = lambda[i][k];
+			lambda[i][k] = (d[k]*lambda[i][k - 1] - l*t) / d[k - 1];
+			lambda[i][k - 1] = (big_b*t + l*lambda[i][k]) / d[k];
+		}
+		d[k - 1] = big_b;
+	};
+	
+	d[0] = 1;
+	d[1] = dot(b[0], b[0]);
+	int k = 2, k_max = 1;
+	while (k <= n) {
+		if (k > k_max) {
+			k_max = k;
+			for (int j = 1; j <= k; j++) {
+				Z u = dot(b[k - 1], b[j - 1]);
+				for (int i = 1; i < j; i++)
+					u = (d[i]*u - lambda[k][i]*lambda[j][i]) / d[i - 1];
+				if (j < k)
+					lambda[k][j] = u;
+				else
+					d[k] = u;
+			}
+		}
+		
+		red(k, k - 1);
+		if (4*d[k]*d[k - 2] < 3*d[k - 1]*d[k - 1] - 4*lambda[k][k - 1]*lambda[k][k - 1]) {
+			swap(k, k_max);
+			k = std::max(2, k - 1);
+		}
+		else {
+			for (int l = k - 2; l >= 1; l--)
+				red(k, l);
+			k++;
+		}
+	}
+	
+	return b;
+}
+
+struct residue_lattice {
+	// The vectors v with sum v_j r^j = 0 mod p^k, LLL-reduced, along with
+	// their Gram-Schmidt orthogonalization
+	std::vector<std::vector<Z>> basis;
+	std::vector<std::vector<Q>> b_star;
+	std::vector<Q> bb;
+};
+
+static residue_lattice make_residue_lattice(Z r, Z pk, int m) {
+	residue_lattice lattice;
+	Z r_pow = 1;
+	for (int j = 0; j < m; j++) {
+		std::vector<Z> row(m, 0);
+		if (j == 0)
+			row[0] = pk;
+		else {
+			row[0] = pk - r_pow;
+			row[j] = 1;
+		}
+		lattice.basis.push_back(row);
+		r_pow = r_pow * r % pk;
+	}
+	lattice.basis = lll_reduce(lattice.basis);
+	
+	for (int i = 0; i < m; i++) {
+		std::vector<Q> v(m);
+		for (int j = 0; j < m; j++)
+			v[j] = lattice.basis[i][j];
+		for (int l = 0; l < i; l++) {
+			Q dot = 0;
+			for (int j = 0; j < m; j++)
+				dot += lattice.basis[i][j]*lattice.b_star[l][j];
+			Q mu = dot / lattice.bb[l];
+			for (int j = 0; j < m; j++)
+				v[j] -= mu*lattice.b_star[l][j];
+		}
+		Q norm = 0;
+		for (int j = 0; j < m; j++)
+			norm += v[j]*v[j];
+		lattice.b_star.push_back(v);
+		lattice.bb.push_back(norm);
+	}
+	return lattice;
+}
+
+static std::vector<Z> reduce_by_lattice(std::vector<Z> w, const residue_lattice &lattice) {
+	// Babai's nearest plane algorithm: subtracts from w a lattice vector
+	// close to it. If some v = w (mod the lattice) has |v| at most half of
+	// every |b*_i|, this returns exactly that v.
+	
+	int m = w.size();
+	for (int i = m - 1; i >= 0; i--) {
+		Q dot = 0;
+		for (int j = 0; j < m; j++)
+			dot += w[j]*lattice.b_star[i][j];
+		Q half = dot / lattice.bb[i] + Q(1, 2);
+		Z q;
+		mpz_fdiv_q(q.get_mpz_t(), half.get_num_mpz_t(), half.get_den_mpz_t());
+		if (q != 0) {
+			for (int j = 0; j < m; j++)
+				w[j] -= q*lattice.basis[i][j];
+		}
+	}
+	return w;
+}
+
+bool padic_factor_squarefree(poly<polymod<Q>> u, std::vector<poly<polymod<Q>>> &result) {
+	// Factors u over K = Q(alpha) without computing any norms, returning
+	// false if no suitable prime turns up.
+	// Replacing alpha by theta = lc(T) alpha and x by x/D makes the
+	// minimal polynomial S of theta and u itself monic with coefficients in
+	// Z[theta]. For a prime p not dividing disc(S) at which S has a root r,
+	// P = (p, theta - r) is a prime of degree 1, so reducing mod P maps
+	// Z[theta] onto Z/p. The factors of u mod P are lifted to p^k by
+	// Hensel's lemma, with theta going to the lift of r. Each monic factor
+	// over K has coefficients in (1/disc(S)) Z[theta] whose coordinates are
+	// bounded through the complex embeddings, so they are recovered from
+	// their images mod p^k with a reduced basis of the lattice of vectors
+	// mapping to 0, and then products of the lifted factors are tried
+	// by trial division as in Algorithm 3.5.7.
+	
+	int n = u.degree();
+	if (n < 1)
+		return false;
+	polymod<Q> reference = u.leading();
+	Q_X t = reference.get_base();
+	if (t.degree() < 1)
+		return false;
+	
+	u = u / u.leading();
+	if (n == 1) {
+		result.push_back(u);
+		return true;
+	}
+	
+	Z_X t_z = primitive_part(t);
+	int m = t_z.degree();
+	Z lc = t_z[m];
+	std::vector<Z> s_coeffs(m + 1);
+	s_coeffs[m] = 1;
+	Z lc_pow = 1;
+	for (int i = m - 1; i >= 0; i--) {
+		s_coeffs[i] = t_z[i]*lc_pow;
+		lc_pow *= lc;
+	}
+	Z_X s(s_coeffs);
+	
+	Z den = abs(sub_resultant(s, s.derivative()));
+	if (den == 0)
+		return false;
+	
+	// Coordinates of the coefficients of u in powers of theta, and then
+	// those of g(x) = D^n u(x/D)
+	std::vector<std::vector<Q>> coords(n + 1, std::vector<Q>(m, 0));
+	Z d = 1;
+	for (int i = 0; i <= n; i++) {
+		Q_X value = u[i].get_value();
+		Z lc_power = 1;
+		for (int j = 0; j < m; j++) {
+			if (j <= value.degree())
+				coords[i][j] = value[j] / static_cast<Q>(lc_power);
+			d = lcm(d, coords[i][j].get_den());
+			lc_power *= lc;
+		}
+	}
+	std::vector<std::vector<Z>> g_coords(n + 1, std::vector<Z>(m));
+	Z d_pow = 1;
+	for (int i = n; i >= 0; i--) {
+		for (int j = 0; j < m; j++)
+			g_coords[i][j] = Q(coords[i][j] * d_pow).get_num();
+		d_pow *= d;
+	}
+	
+	auto residue = [&](Z r, Z modulus) {
+		std::vector<Z> coeffs;
+		for (int i = 0; i <= n; i++) {
+			Z c = 0;
+			for (int j = m - 1; j >= 0; j--)
+				c = (c*r + g_coords[i][j]) % modulus;
+			if (c < 0)
+				c += modulus;
+			coeffs.push_back(c);
+		}
+		return Z_X(coeffs);
+	};
+	
+	// Among the first few usable primes, take the one giving the fewest
+	// factors
+	Z p = 1, best_p = 0, best_r;
+	std::vector<ZN_X> best_factors;
+	int candidates = 0;
+	for (int tries = 0; tries < padic_factor_max_primes && candidates < 5; tries++) {
+		mpz_nextprime(p.get_mpz_t(), p.get_mpz_t());
+		if (den % p == 0)
+			continue;
+		
+		Z r = 0;
+		for (; r < p; r++) {
+			Z value = 0;
+			for (int i = m; i >= 0; i--)
+				value = (value*r + s[i]) % p;
+			if (value == 0)
+				break;
+		}
+		if (r == p)
+			continue;
+		
+		ZN_X g_p = residue(r, p).convert(to_mod(p));
+		if (std::get<2>(extended_gcd(g_p, g_p.derivative())).degree() != 0)
+			continue;
+		
+		candidates++;
+		std::vector<ZN_X> factors = berlekamp_auto(g_p);
+		if (best_p == 0 || factors.size() < best_factors.size()) {
+			best_p = p;
+			best_r = r;
+			best_factors = factors;
+		}
+	}
+	if (best_p == 0)
+		return false;
+	if (best_factors.size() == 1) {
+		result.push_back(u);
+		return true;
+	}
+	p = best_p;
+	
+	// Bound the coordinates of den times a coefficient of a monic factor
+	// of g. The roots of S are at most r_bound in absolute value, which
+	// bounds the coefficients of g and, by Mignotte, those of its factors
+	// under every embedding. The coordinates come back through the dual
+	// basis b_j(theta)/S'(theta), where |S'(theta_l)| >= disc(S)/(2 r_bound)^((m-1)^2).
+	Z r_bound = 0;
+	for (int i = 0; i < m; i++)
+		r_bound = std::max(r_bound, Z(abs(s[i])));
+	r_bound += 1;
+	Z g_bound = 0;
+	for (int i = 0; i <= n; i++) {
+		Z sum = 0;
+		for (int j = m - 1; j >= 0; j--)
+			sum = sum*r_bound + abs(g_coords[i][j]);
+		g_bound = std::max(g_bound, sum);
+	}
+	Z bound = util<Z>::get_pow(Z(2), n) * (n + 1) * g_bound;
+	bound *= m*m * util<Z>::get_pow(r_bound, m + 1) * util<Z>::get_pow(2*r_bound, (m - 1)*(m - 1));
+	
+	// Raise k until nearest plane rounding is certain to find these
+	// coordinates, lifting r to a root of S mod p^k along the way
+	Z target = 4 * m*m * bound*bound;
+	int k = log_bound(p, util<Z>::get_pow(2*m*bound, m) * util<Z>::get_pow(Z(2), m*(m - 1)/2));
+	Z pk, r;
+	residue_lattice lattice;
+	while (true) {
+		pk = util<Z>::get_pow(p, k);
+		r = best_r;
+		Z_X s_prime = s.derivative();
+		for (int e = 1; e < 2*k; e *= 2) {
+			Z value = 0, slope = 0, inverse;
+			for (int i = m; i >= 0; i--)
+				value = (value*r + s[i]) % pk;
+			for (int i = m - 1; i >= 0; i--)
+				slope = (slope*r + s_prime[i]) % pk;
+			mpz_invert(inverse.get_mpz_t(), slope.get_mpz_t(), pk.get_mpz_t());
+			r = (r - value*inverse) % pk;
+			if (r < 0)
+				r += pk;
+		}
+		
+		lattice = make_residue_lattice(r, pk, m);
+		bool enough = true;
+		for (int i = 0; i < m; i++)
+			enough = enough && lattice.bb[i] > static_cast<Q>(target);
+		if (enough)
+			break;
+		k += k/2 + 1;
+	}
+	
+	std::vector<Z_X> ui;
+	for (int i = 0; i < best_factors.size(); i++)
+		ui.push_back(static_cast<Z_X>(best_factors[i]));
+	ui = poly_hensel_lift(p, k, ui, residue(r, pk));
+	for (int i = 0; i < ui.size(); i++) {
+		ZN_X ui_n = ui[i].convert(to_mod(pk));
+		ui_n /= ui_n[ui_n.degree()];
+		ui[i] = static_cast<Z_X>(ui_n);
+	}
+	
+	std::vector<polymod<Q>> g_list;
+	std::vector<Q> theta_pows;
+	Z lc_power = 1;
+	for (int j = 0; j < m; j++) {
+		theta_pows.push_back(static_cast<Q>(lc_power));
+		lc_power *= lc;
+	}
+	for (int i = 0; i <= n; i++) {
+		std::vector<Q> value;
+		for (int j = 0; j < m; j++)
+			value.push_back(g_coords[i][j] * theta_pows[j]);
+		g_list.push_back(polymod<Q>(reference, Q_X(value)));
+	}
+	poly<polymod<Q>> g(g_list);
+	
+	// Maps a factor h of g back to the monic factor h(Dx)/D^deg(h) of u
+	auto unscale = [&](poly<polymod<Q>> h) {
+		Z scale = 1;
+		for (int i = h.degree(); i >= 0; i--) {
+			h.set(i, h[i] / polymod<Q>(reference, Q_X(static_cast<Q>(scale))));
+			scale *= d;
+		}
+		return h;
+	};
+	
+	int size = 1;
+	while (2*size <= ui.size()) {
+		std::vector<int> combination;
+		for (int i = 0; i < size; i++)
+			combination.push_back(i);
+		
+		bool found = false;
+		while (true) {
+			// If size = 1/2 r, the complements are the same factors
+			if (2*size == ui.size() && combination[0] > 0)
+				break;
+			
+			Z_X h_bar(1);
+			for (int i = 0; i < size; i++)
+				h_bar = static_cast<Z_X>((h_bar * ui[combination[i]]).convert(to_mod(pk)));
+			
+			std::vector<polymod<Q>> h_list;
+			bool small = true;
+			for (int i = 0; i < h_bar.degree() && small; i++) {
+				std::vector<Z> w(m, 0);
+				w[0] = den * h_bar[i] % pk;
+				w = reduce_by_lattice(w, lattice);
+				std::vector<Q> value;
+				for (int j = 0; j < m && small; j++) {
+					small = abs(w[j]) <= bound;
+					value.push_back(Q(w[j], den) * theta_pows[j]);
+				}
+				h_list.push_back(polymod<Q>(reference, Q_X(value)));
+			}
+			
+			if (small) {
+				h_list.push_back(util<polymod<Q>>::one(reference));
+				poly<polymod<Q>> h(h_list);
+				qr_pair<poly<polymod<Q>>> qr = g.divide(h);
+				if (qr.remainder.degree() < 0) {
+					result.push_back(unscale(h));
+					g = qr.quotient;
+					for (int i = 0; i < size; i++)
+						ui.erase(ui.begin() + combination[i] - i);
+					found = true;
+					break;
+				}
+			}
+			
+			// Increment combination
+			int start_point = size - 1;
+			combination[size - 1]++;
+			while (combination[size - 1] >= ui.size()) {
+				start_point--;
+				if (start_point < 0)
+					break;
+				combination[start_point]++;
+				for (int i = start_point + 1; i < size; i++)
+					combination[i] = combination[i-1] + 1;
+			}
+			if (start_point < 0)
+				break;
+		}
+		
+		if (!found)
+			size++;
+	}
+	
+	if (g.degree() >= 1)
+		result.push_back(unscale(g));
+	return true;
+}
+
+std::vector<poly<polymod<Q>>> factor_squarefree(poly<polymod<Q>> u) {
+	// p-adic factorization when it applies, and Trager's algorithm
+	// otherwise
+	
+	std::vector<poly<polymod<Q>>> result;
+	if (padic_factor_squarefree(u, result))
+		return result;
+	return factor_squarefree<Q>(u);
+}
+
+std::vector<poly<numberfield>> factor(poly<numberfield> a) {
+	if (a.degree() < 0)
+		return std::vector<poly<numberfield>>({a});
+	
+	// Find the largest field the coefficients lie in. Rather than work
+	// through every level of a tower of extensions, flatten it into Q(theta)
+	// for a primitive element theta and factor there.
+	int field_index = -1;
+	for (int i = 0; i <= a.degree(); i++) {
+		if (a[i].is_poly() && (field_index < 0 || a[i].get_field()->depth > a[field_index].get_field()->depth))
+			field_index = i;
+	}
+	
+	if (field_index >= 0) {
+		absolute_field flat(a[field_index]);
+		std::vector<poly<polymod<Q>>> factors = factor(flat.flatten(a));
+		std::vector<poly<numberfield>> result;
+		for (int i = 0; i < factors.size(); i++)
+			result.push_back(flat.unflatten(factors[i]));
+		return result;
+	}
+	
+	std::vector<Q> coeffs;
+	for (int i = 0; i <= a.degree(); i++)
+		coeffs.push_back(a[i].get_rational_value());
+	std::vector<poly<Q>> factors = factor(poly<Q>(coeffs));
+	std::vector<poly<numberfield>> result;
+	for (int i = 0; i < factors.size(); i++)
+		result.push_back((poly<numberfield>)factors[i]);
+	return result;
+}
+
+static bool double_complex_roots(const std::vector<std::complex<double>> &p, std::vector<std::complex<double>> &roots) {
+	// Algorithm 3.6.6 in hardware doubles, only to get starting points.
+	// Returns false if the iteration breaks down.
+	
+	typedef std::complex<double> D;
+	auto evaluate = [](const std::vector<D> &a, D x) {
+		D result = 0;
+		for (int i = a.size() - 1; i >= 0; i--)
+			result = result*x + a[i];
+		return result;
+	};
+	auto deflate = [](std::vector<D> &a, D r) {
+		// Synthetic division by x - r
+		int n = a.size() - 1;
+		std::vector<D> b(n);
+		b[n - 1] = a[n];
+		for (int i = n - 1; i > 0; i--)
+			b[i - 1] = a[i] + r*b[i];
+		a = b;
+	};
+	
+	std::vector<D> q = p;
+	while (q.size() > 1) {
+		std::vector<D> q_prime;
+		for (int i = 1; i < q.size(); i++)
+			q_prime.push_back(q[i]*static_cast<double>(i));
+		
+		D x(1.3, 0.314159);
+		D v = evaluate(q, x);
+		double m = std::norm(v);
+		for (int iteration = 0; iteration < 500; iteration++) {
+			D dx = v / evaluate(q_prime, x);
+			if (!std::isfinite(dx.real()) || !std::isfinite(dx.imag()))
+				return false;
+			if (std::abs(dx) <= 1e-15*std::abs(x))
+				break;
+			
+			int c = 0;
+			for (; c < 20; c++) {
+				D y = x - dx;
+				D v1 = evaluate(q, y);
+				double m1 = std::norm(v1);
+				if (m1 < m) {
+					x = y;
+					v = v1;
+					m = m1;
+					break;
+				}
+				dx /= 4.0;
+			}
+			// Once rounding dominates, no step makes |q(x)| any smaller
+			if (c >= 20)
+				break;
+		}
+		
+		if (q.size() == 2 || std::abs(x.imag()) <= 1e-8*std::abs(x)) {
+			roots.push_back(x.real());
+			deflate(q, x.real());
+		}
+		else {
+			roots.push_back(x);
+			roots.push_back(std::conj(x));
+			deflate(q, x);
+			deflate(q, std::conj(x));
+		}
+		for (int i = 0; i < q.size(); i++)
+			q[i] = q[i].real();
+	}
+	
+	return true;
+}
+
+// GCC builds the batch kernel for AVX-512 and AVX2 as well as the baseline
+// x86-64, picking the best one at load time; elsewhere it is compiled once
+// for the target
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__)
+#define HORNER_BATCH_TARGETS __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define HORNER_BATCH_TARGETS
+#endif
+
+HORNER_BATCH_TARGETS
+void evaluate_with_derivative_batch(const std::vector<std::complex<double>> &p, const std::vector<std::complex<double>> &x, std::vector<std::complex<double>> &values, std::vector<std::complex<double>> &slopes) {
+	// Horner's rule for p and p' in doubles, horner_batch_lanes points at
+	// a time. Each point's real and imaginary parts sit in separate lane
+	// arrays, so every step is the same few operations across all the
+	// lanes, which the optimizer turns into vector instructions.
+	
+	const int lanes = horner_batch_lanes;
+	int n = p.size();
+	std::vector<double> p_re(n), p_im(n);
+	for (int i = 0; i < n; i++) {
+		p_re[i] = p[i].real();
+		p_im[i] = p[i].imag();
+	}
+	
+	values.resize(x.size());
+	slopes.resize(x.size());
+	for (int start = 0; start < x.size(); start += lanes) {
+		int count = std::min(lanes, (int) x.size() - start);
+		double x_re[lanes], x_im[lanes], v_re[lanes], v_im[lanes], s_re[lanes], s_im[lanes];
+		for (int l = 0; l < lanes; l++) {
+			x_re[l] = l < count ? x[start + l].real() : 0;
+			x_im[l] = l < count ? x[start + l].imag() : 0;
+			v_re[l] = v_im[l] = s_re[l] = s_im[l] = 0;
+		}
+		
+		for (int i = n - 1; i >= 0; i--) {
+			for (int l = 0; l < lanes; l++) {
+				double sr = s_re[l]*x_re[l] - s_im[l]*x_im[l] + v_re[l];
+				double si = s_re[l]*x_im[l] + s_im[l]*x_re[l] + v_im[l];
+				double vr = v_re[l]*x_re[l] - v_im[l]*x_im[l] + p_re[i];
+				double vi = v_re[l]*x_im[l] + v_im[l]*x_re[l] + p_im[i];
+				s_re[l] = sr;
+				s_im[l] = si;
+				v_re[l] = vr;
+				v_im[l] = vi;
+			}
+		}
+		
+		for (int l = 0; l < count; l++) {
+			values[start + l] = std::complex<double>(v_re[l], v_im[l]);
+			slopes[start + l] = std::complex<double>(s_re[l], s_im[l]);
+		}
+	}
+}
+
+static bool polish_root(const C_X &p, const std::vector<dd_complex> &p_dd, std::complex<double> start, R prec_limit, const precision_context &context, C &root) {
+	// Newton's method on p from a double precision starting point, first in
+	// double-double and then in mpf at the context's precision until the
+	// step is below prec_limit. Returns false if that doesn't happen
+	// quickly.
+	
+	dd_complex x(dd_real(start.real()), dd_real(start.imag()));
+	for (int iteration = 0; iteration < 8; iteration++) {
+		dd_complex v, d;
+		for (int i = p_dd.size() - 1; i >= 0; i--) {
+			d = d*x + v;
+			v = v*x + p_dd[i];
+		}
+		dd_complex dx = v / d;
+		if (!std::isfinite(dx.real.hi) || !std::isfinite(dx.imag.hi))
+			break;
+		x = x - dx;
+		if (dx.abs() <= 1e-30*x.abs())
+			break;
+	}
+	
+	root = x.to_complex(context.bits);
+	for (int iteration = 0; iteration < root_polish_max_iterations; iteration++) {
+		std::pair<C, C> v = p.evaluate_with_derivative(root);
+		C dx = v.first / v.second;
+		root -= dx;
+		if (sqrt(dx.norm()) < prec_limit)
+			return true;
+	}
+	return false;
+}
+
+static bool staged_complex_roots(const Q_X &p_q, R prec_limit, const precision_context &context, std::vector<C> &roots, unsigned int threads) {
+	// Finds the roots of the squarefree p_q with double precision Newton
+	// and deflation, then polishes each against p_q itself in
+	// double-double and finally in mpf. Returns false when this can't be
+	// trusted, so that the caller can work in mpf throughout. The roots
+	// are polished independently, spread over the given number of threads.
+	
+	std::vector<std::complex<double>> p_d;
+	for (int i = 0; i <= p_q.degree(); i++) {
+		double c = p_q[i].get_d();
+		if (!std::isfinite(c) || (c == 0) != (p_q[i] == 0))
+			return false;
+		p_d.push_back(c);
+	}
+	
+	std::vector<std::complex<double>> starts;
+	if (!double_complex_roots(p_d, starts))
+		return false;
+	
+	// Screen the starting points against p itself before any mpf work: a
+	// non-finite value or a vanishing derivative means Newton can't polish
+	std::vector<std::complex<double>> values, slopes;
+	evaluate_with_derivative_batch(p_d, starts, values, slopes);
+	for (int i = 0; i < starts.size(); i++) {
+		if (!std::isfinite(std::abs(values[i])) || !std::isfinite(std::abs(slopes[i])) || slopes[i] == 0.0)
+			return false;
+	}
+	
+	std::vector<C> p_coeffs;
+	std::vector<dd_complex> p_dd;
+	for (int i = 0; i <= p_q.degree(); i++) {
+		p_coeffs.push_back(context.to_complex(p_q[i]));
+		p_dd.push_back(dd_complex(p_coeffs[i]));
+	}
+	C_X p(p_coeffs);
+	
+	std::vector<C> polished(starts.size());
+	std::vector<char> converged(starts.size());
+	parallel_for(starts.size(), [&](int i) {
+		converged[i] = polish_root(p, p_dd, starts[i], prec_limit, context, polished[i]);
+		if (abs(polished[i].get_imag()) < prec_limit)
+			polished[i] = polished[i].get_real();
+	}, threads);
+	for (int i = 0; i < starts.size(); i++)
+		if (!converged[i])
+			return false;
+	roots.insert(roots.end(), polished.begin(), polished.end());
+	
+	// Two starting points may have been polished onto the same root
+	for (int i = 0; i < roots.size(); i++)
+		for (int j = i + 1; j < roots.size(); j++)
+			if (sqrt((roots[i] - roots[j]).norm()) < 2*prec_limit)
+				return false;
+	
+	return true;
+}
+
+std::vector<C> find_complex_roots(Q_X p_q, int precision, unsigned int threads) {
+	return find_complex_roots(p_q, precision, precision_context::from_default(), threads);
+}
+
+std::vector<C> find_complex_roots(Q_X p_q, int precision, const precision_context &context, unsigned int threads) {
+	// Algorithm 3.6.6
+	// Most of the iterations don't need the full precision, so the roots
+	// are found in doubles and only polished in mpf where possible, see
+	// staged_complex_roots. Otherwise everything runs in mpf. Every R and C
+	// is made at the context's precision, whatever mpf's default is.
+	
+	R prec_limit = context.to_real(1.0);
+	for (int i = 0; i < precision; i++)
+		prec_limit /= 10;
+	
+	// Note that unlike 3.6.6, here we do not assume p to be squarefree
+	p_q = p_q / sub_resultant_gcd(p_q, p_q.derivative());
+	
+	std::vector<C> staged;
+	if (staged_complex_roots(p_q, prec_limit, context, staged, threads))
+		return staged;
+	
+	std::vector<C> p_coeffs;
+	for (int i = 0; i <= p_q.degree(); i++)
+		p_coeffs.push_back(context.to_complex(p_q[i]));
+	C one = context.to_complex(1, 0);
+	
+	C_X p(p_coeffs);
+	C_X q = p;
+	int n = p.degree();
+	
+	std::vector<C> roots;
+	
+	while (n > 0) {
+		// v holds q(x) and q'(x), which each trial point computes together
+		C x = context.to_complex(1.3, 0.314159);
+		std::pair<C, C> v = q.evaluate_with_derivative(x);
+		R m = v.first.norm();
+		
+		while (true) {
+			int c = 0;
+			C dx = v.first / v.second;
+			if (sqrt(dx.norm()) < prec_limit)
+				break;
+			
 			while (true) {
 				C y = x - dx;
-				C v1 = q.evaluate(y);
-				R m1 = v1.norm();
+				std::pair<C, C> v1 = q.evaluate_with_derivative(y);
+				R m1 = v1.first.norm();
 				
 				if (m1 < m) {
 					x = y;
@@ -717,24 +2385,403 @@ std::vector<C> find_complex_roots(Q_X p_q, int precision) {
 			}
 		}
 		
-		x -= p.evaluate(x)/p_prime.evaluate(x);
-		x -= p.evaluate(x)/p_prime.evaluate(x);
+		for (int i = 0; i < 2; i++) {
+			std::pair<C, C> pv = p.evaluate_with_derivative(x);
+			x -= pv.first/pv.second;
+		}
 		
-		if (x.get_imag() < prec_limit) {
+		if (abs(x.get_imag()) < prec_limit) {
 			x = x.get_real();
 			roots.push_back(x);
-			q /= C_X({-x, 1});
-			q_prime = q.derivative();
+			q /= C_X({-x, one});
 			n--;
 		}
 		else {
 			roots.push_back(x);
 			roots.push_back(x.conjugate());
-			q /= C_X({x.norm(), R(-2*x.get_real()), 1});
-			q_prime = q.derivative();
+			q /= C_X({x.norm(), R(-2*x.get_real()), one});
 			n -= 2;
 		}
 	}
 	
 	return roots;
+}
+
+std::vector<std::vector<C>> find_complex_roots(const std::vector<Q_X> &polys, int precision, unsigned int threads) {
+	return find_complex_roots(polys, precision, precision_context::from_default(), threads);
+}
+
+std::vector<std::vector<C>> find_complex_roots(const std::vector<Q_X> &polys, int precision, const precision_context &context, unsigned int threads) {
+	// The polynomials are independent, so they get the threads first, and
+	// any left over go to polishing the roots of each one
+	if (threads == 0)
+		threads = thread_count();
+	unsigned int outer = std::max(1u, std::min(threads, (unsigned int) polys.size()));
+	unsigned int inner = std::max(1u, threads / outer);
+	
+	std::vector<std::vector<C>> roots(polys.size());
+	parallel_for(polys.size(), [&](int i) {
+		roots[i] = find_complex_roots(polys[i], precision, context, inner);
+	}, outer);
+	return roots;
+}
+
+static double log_abs(const Q &a) {
+	// log |a| without overflowing a double for huge numerators or
+	// denominators
+	long num_exp, den_exp;
+	double num = mpz_get_d_2exp(&num_exp, a.get_num_mpz_t());
+	double den = mpz_get_d_2exp(&den_exp, a.get_den_mpz_t());
+	return std::log(std::abs(num / den)) + (num_exp - den_exp)*std::log(2.0);
+}
+
+std::vector<C> find_complex_roots_aberth(Q_X p_q, int precision) {
+	return find_complex_roots_aberth(p_q, precision, precision_context::from_default());
+}
+
+static bool double_aberth(const std::vector<std::complex<double>> &p, std::vector<std::complex<double>> &z) {
+	// The Aberth-Ehrlich iteration in hardware doubles, as a warm start for
+	// find_complex_roots_aberth. Each sweep evaluates p and p' at every z_k
+	// at once with evaluate_with_derivative_batch, so unlike the mpf
+	// version the updates are simultaneous (Jacobi rather than
+	// Gauss-Seidel). Returns false, leaving z alone, if anything overflows
+	// or the sweeps run out before every correction is down to rounding.
+	
+	typedef std::complex<double> D;
+	int n = z.size();
+	std::vector<D> x = z, values, slopes, w(n);
+	for (int iteration = 0; iteration < aberth_max_iterations; iteration++) {
+		evaluate_with_derivative_batch(p, x, values, slopes);
+		
+		bool converged = true;
+		for (int k = 0; k < n; k++) {
+			D ratio = values[k] / slopes[k];
+			D sum = 0;
+			for (int j = 0; j < n; j++)
+				if (j != k)
+					sum += 1.0 / (x[k] - x[j]);
+			w[k] = ratio / (1.0 - ratio*sum);
+			if (!std::isfinite(w[k].real()) || !std::isfinite(w[k].imag()))
+				return false;
+			if (std::abs(w[k]) > 1e-14*std::abs(x[k]))
+				converged = false;
+		}
+		for (int k = 0; k < n; k++)
+			x[k] -= w[k];
+		
+		if (converged) {
+			z = x;
+			return true;
+		}
+	}
+	return false;
+}
+
+std::vector<C> find_complex_roots_aberth(Q_X p_q, int precision, const precision_context &context) {
+	// Refines all the roots at once with the Aberth-Ehrlich iteration
+	//   z_k -= w_k / (1 - w_k sum_(j != k) 1/(z_k - z_j)), w_k = p(z_k)/p'(z_k),
+	// using each new z_k as soon as it is computed. The starting points lie
+	// on circles whose radii come from the upper convex hull of the points
+	// (i, log |a_i|), capped by Fujiwara's bound on the roots, with as many
+	// points on each circle as the hull edge is wide. A root stops moving
+	// once its correction is below 10^-precision. When p fits in doubles,
+	// the iteration first runs there (see double_aberth) and mpf only
+	// finishes it off.
+	
+	R prec_limit = context.to_real(1.0);
+	for (int i = 0; i < precision; i++)
+		prec_limit /= 10;
+	
+	p_q = p_q / sub_resultant_gcd(p_q, p_q.derivative());
+	std::vector<C> roots;
+	
+	// Since p is squarefree, 0 is at most a simple root
+	if (p_q.degree() >= 1 && p_q[0] == 0) {
+		roots.push_back(context.to_complex(0, 0));
+		p_q = p_q.divide(Q_X({0, 1})).quotient;
+	}
+	int n = p_q.degree();
+	if (n < 1)
+		return roots;
+	
+	std::vector<double> log_a(n + 1);
+	std::vector<int> support;
+	for (int i = 0; i <= n; i++) {
+		if (p_q[i] == 0)
+			continue;
+		log_a[i] = log_abs(p_q[i]);
+		support.push_back(i);
+	}
+	
+	double log_fujiwara = -HUGE_VAL;
+	for (int i = 0; i < n; i++) {
+		if (p_q[i] == 0)
+			continue;
+		double bound = (log_a[i] - log_a[n] - (i == 0 ? std::log(2.0) : 0)) / (n - i);
+		log_fujiwara = std::max(log_fujiwara, bound);
+	}
+	log_fujiwara += std::log(2.0);
+	
+	std::vector<int> hull;
+	for (int i = 0; i < support.size(); i++) {
+		int c = support[i];
+		while (hull.size() >= 2) {
+			int a = hull[hull.size() - 2], b = hull[hull.size() - 1];
+			// Drop b if it lies on or below the segment from a to c
+			if ((log_a[b] - log_a[a])*(c - a) > (log_a[c] - log_a[a])*(b - a))
+				break;
+			hull.pop_back();
+		}
+		hull.push_back(c);
+	}
+	
+	std::vector<std::complex<double>> z_d;
+	const double two_pi = 8*std::atan(1.0);
+	for (int h = 0; h + 1 < hull.size(); h++) {
+		int i = hull[h], j = hull[h + 1];
+		double log_r = std::min((log_a[i] - log_a[j]) / (j - i), log_fujiwara);
+		double r = std::exp(log_r);
+		for (int k = 0; k < j - i; k++) {
+			double angle = two_pi*k/(j - i) + two_pi*i/n + 0.7;
+			z_d.push_back(std::polar(r, angle));
+		}
+	}
+	
+	std::vector<std::complex<double>> p_d;
+	bool fits_double = true;
+	for (int i = 0; i <= n; i++) {
+		double c = p_q[i].get_d();
+		if (!std::isfinite(c) || (c == 0) != (p_q[i] == 0))
+			fits_double = false;
+		p_d.push_back(c);
+	}
+	if (fits_double)
+		double_aberth(p_d, z_d);
+	
+	std::vector<C> z;
+	for (int k = 0; k < n; k++)
+		z.push_back(context.to_complex(z_d[k].real(), z_d[k].imag()));
+	
+	std::vector<C> p_coeffs;
+	for (int i = 0; i <= n; i++)
+		p_coeffs.push_back(context.to_complex(p_q[i]));
+	C_X p(p_coeffs);
+	C zero = context.to_complex(0, 0), one = context.to_complex(1, 0);
+	
+	std::vector<bool> converged(n, false);
+	int remaining = n;
+	for (int iteration = 0; iteration < aberth_max_iterations && remaining > 0; iteration++) {
+		for (int k = 0; k < n; k++) {
+			if (converged[k])
+				continue;
+			
+			std::pair<C, C> v = p.evaluate_with_derivative(z[k]);
+			C ratio = v.first / v.second;
+			C sum = zero;
+			for (int j = 0; j < n; j++)
+				if (j != k)
+					sum += (z[k] - z[j]).inv();
+			C w = ratio / (one - ratio*sum);
+			z[k] -= w;
+			
+			if (sqrt(w.norm()) < prec_limit) {
+				converged[k] = true;
+				remaining--;
+			}
+		}
+	}
+	
+	// Some roots never settled, e.g. in a tight cluster, so use Newton with
+	// deflation instead
+	if (remaining > 0) {
+		std::vector<C> fallback = find_complex_roots(p_q, precision, context);
+		roots.insert(roots.end(), fallback.begin(), fallback.end());
+		return roots;
+	}
+	
+	// Roots of a real polynomial within the tolerance of the real axis are
+	// taken to be real
+	for (int k = 0; k < n; k++) {
+		if (abs(z[k].get_imag()) < prec_limit)
+			z[k] = z[k].get_real();
+		roots.push_back(z[k]);
+	}
+	
+	return roots;
+}
+
+static Z_X squarefree_integral_part(Z_X p) {
+	Q_X p_q = static_cast<Q_X>(p);
+	return primitive_part(p_q / sub_resultant_gcd(p_q, p_q.derivative()));
+}
+
+static void taylor_shift_one(std::vector<Z> &a) {
+	// a(x) -> a(x + 1). The leading coefficient is unchanged, so the
+	// degree is too.
+	Z_X shifted = Z_X(a).taylor_shift(Z(1));
+	for (int i = 0; i < a.size(); i++)
+		a[i] = shifted[i];
+}
+
+static int unit_interval_sign_variations(const std::vector<Z> &a) {
+	// Descartes' rule for (0, 1): the sign variations of
+	// (x + 1)^n a(1/(x + 1)) bound the number of roots of a in (0, 1), and
+	// 0 or 1 variations are exact
+	std::vector<Z> b(a.rbegin(), a.rend());
+	taylor_shift_one(b);
+	
+	int variations = 0, last = 0;
+	for (int i = 0; i < b.size(); i++) {
+		int s = sgn(b[i]);
+		if (s == 0)
+			continue;
+		if (last != 0 && s != last)
+			variations++;
+		last = s;
+	}
+	return variations;
+}
+
+static void isolate_positive_roots(std::vector<Z> a, std::vector<real_root_interval> &roots) {
+	// Vincent-Collins-Akritas bisection. a must be squarefree with a(0) != 0.
+	// Scaling by a power of two B above Cauchy's bound moves the positive
+	// roots into (0, 1). The polynomial 2^n q(x/2) covers the left half of
+	// q's interval and its shift by 1 the right half, so coefficients stay
+	// integral and a midpoint root shows up as a root at 1.
+	
+	int n = a.size() - 1;
+	if (n < 1)
+		return;
+	
+	Q bound = 0;
+	for (int i = 0; i < n; i++)
+		bound = std::max(bound, Q(abs(Q(a[i]) / a[n])));
+	bound += 1;
+	int e = 0;
+	while (Q(Z(1) << e) <= bound)
+		e++;
+	for (int i = 0; i <= n; i++)
+		a[i] <<= e*i;
+	
+	// The interval of node (c, k) is (c/2^k, (c + 1)/2^k) times 2^e
+	auto point = [e](Z c, int k) {
+		Q result(c << e, Z(1) << k);
+		result.canonicalize();
+		return result;
+	};
+	
+	struct node {
+		std::vector<Z> q;
+		Z c;
+		int k;
+	};
+	std::vector<node> stack;
+	stack.push_back({a, 0, 0});
+	while (!stack.empty()) {
+		node current = stack.back();
+		stack.pop_back();
+		
+		int variations = unit_interval_sign_variations(current.q);
+		if (variations == 0)
+			continue;
+		if (variations == 1) {
+			roots.push_back({point(current.c, current.k), point(current.c + 1, current.k)});
+			continue;
+		}
+		
+		std::vector<Z> left = current.q;
+		int m = left.size() - 1;
+		for (int i = 0; i <= m; i++)
+			left[i] <<= m - i;
+		
+		Z sum = 0;
+		for (int i = 0; i <= m; i++)
+			sum += left[i];
+		if (sum == 0) {
+			Q midpoint = point(2*current.c + 1, current.k + 1);
+			roots.push_back({midpoint, midpoint});
+			// Synthetic division by x - 1
+			std::vector<Z> quotient(m);
+			quotient[m - 1] = left[m];
+			for (int i = m - 1; i > 0; i--)
+				quotient[i - 1] = left[i] + quotient[i];
+			left = quotient;
+		}
+		
+		std::vector<Z> right = left;
+		taylor_shift_one(right);
+		stack.push_back({left, 2*current.c, current.k + 1});
+		stack.push_back({right, 2*current.c + 1, current.k + 1});
+	}
+}
+
+std::vector<real_root_interval> isolate_real_roots(Z_X p) {
+	// Returns disjoint intervals in increasing order, one for each real
+	// root of p, ignoring multiplicity
+	
+	std::vector<real_root_interval> roots;
+	if (p.degree() < 1)
+		return roots;
+	
+	p = squarefree_integral_part(p);
+	std::vector<Z> a;
+	for (int i = 0; i <= p.degree(); i++)
+		a.push_back(p[i]);
+	if (a[0] == 0) {
+		roots.push_back({Q(0), Q(0)});
+		a.erase(a.begin());
+	}
+	
+	isolate_positive_roots(a, roots);
+	
+	std::vector<real_root_interval> negative;
+	for (int i = 1; i < a.size(); i += 2)
+		a[i] = -a[i];
+	isolate_positive_roots(a, negative);
+	for (int i = 0; i < negative.size(); i++)
+		roots.push_back({-negative[i].upper, -negative[i].lower});
+	
+	std::sort(roots.begin(), roots.end(), [](const real_root_interval &x, const real_root_interval &y) {
+		return x.lower < y.lower || (x.lower == y.lower && x.upper < y.upper);
+	});
+	return roots;
+}
+
+std::vector<real_root_interval> isolate_real_roots(Q_X p) {
+	if (p.degree() < 1)
+		return std::vector<real_root_interval>();
+	return isolate_real_roots(primitive_part(p));
+}
+
+real_root_interval refine_real_root(Z_X p, real_root_interval interval, Q width) {
+	// Bisects an interval from isolate_real_roots(p) until it is at most
+	// width wide. Its endpoints may be roots themselves, but only simple
+	// ones, so just inside the lower end p has the sign of p'(lower).
+	
+	if (interval.lower == interval.upper)
+		return interval;
+	
+	Q_X p_q = static_cast<Q_X>(squarefree_integral_part(p));
+	int lower_sign = sgn(p_q.evaluate(interval.lower));
+	if (lower_sign == 0)
+		lower_sign = sgn(p_q.derivative().evaluate(interval.lower));
+	
+	while (interval.upper - interval.lower > width) {
+		Q midpoint = (interval.lower + interval.upper) / 2;
+		int s = sgn(p_q.evaluate(midpoint));
+		if (s == 0) {
+			interval.lower = midpoint;
+			interval.upper = midpoint;
+			break;
+		}
+		if (s == lower_sign)
+			interval.lower = midpoint;
+		else
+			interval.upper = midpoint;
+	}
+	return interval;
+}
+
+real_root_interval refine_real_root(Q_X p, real_root_interval interval, Q width) {
+	return refine_real_root(primitive_part(p), interval, width);
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include <Eigen/Dense>
 #include <utility>
 #include <tuple>
+#include <complex>
 #include "numbers.h"
 #include "numberfield.h"
 #include "polyring.h"
@@ -10,6 +11,7 @@
 #include "complex.h"
 #include "polymodring.h"
 #include "typedefs.h"
+#include "parallel.h"
 
 #pragma once
 
@@ -86,9 +88,110 @@ std::vector<vec<T>> kernel(mat<T> m) {
 	return ret;
 }
 
+// Below this degree the classical Euclidean loop in extended_gcd
+// is faster than the half-GCD recursion.
+const int half_gcd_threshold = 64;
+
+template <typename T>
+struct gcd_matrix {
+	public:
+		poly<T> m11, m12;
+		poly<T> m21, m22;
+};
+
+template <typename T>
+gcd_matrix<T> identity_gcd_matrix(const T &reference) {
+	gcd_matrix<T> m;
+	m.m11 = poly<T>(util<T>::one(reference));
+	m.m22 = poly<T>(util<T>::one(reference));
+	return m;
+}
+
+template <typename T>
+gcd_matrix<T> operator*(const gcd_matrix<T> &a, const gcd_matrix<T> &b) {
+	gcd_matrix<T> m;
+	m.m11 = a.m11*b.m11 + a.m12*b.m21;
+	m.m12 = a.m11*b.m12 + a.m12*b.m22;
+	m.m21 = a.m21*b.m11 + a.m22*b.m21;
+	m.m22 = a.m21*b.m12 + a.m22*b.m22;
+	return m;
+}
+
+template <typename T>
+gcd_matrix<T> euclid_step(const gcd_matrix<T> &m, const poly<T> &q) {
+	// Multiplies m on the left by the matrix (0 1; 1 -q) of one
+	// Euclidean division (a, b) -> (b, a - q*b).
+	gcd_matrix<T> result;
+	result.m11 = m.m21;
+	result.m12 = m.m22;
+	result.m21 = m.m11 - q*m.m21;
+	result.m22 = m.m12 - q*m.m22;
+	return result;
+}
+
+template <typename T>
+std::pair<poly<T>, poly<T>> apply_gcd_matrix(const gcd_matrix<T> &m, const poly<T> &a, const poly<T> &b) {
+	return std::make_pair(m.m11*a + m.m12*b, m.m21*a + m.m22*b);
+}
+
+template <typename T>
+gcd_matrix<T> half_gcd(poly<T> a, poly<T> b) {
+	// Given deg(a) >= deg(b), this returns the product M of the Euclidean
+	// quotient matrices which takes (a, b) to (c, d) = M(a, b) with
+	// deg(d) < ceil(deg(a)/2) <= deg(c).
+	// The first half of the remainder sequence only depends on the top
+	// half of the coefficients, which is what makes the recursion work.
+	
+	int m = (a.degree() + 1) / 2;
+	if (b.degree() < m)
+		return identity_gcd_matrix(a.leading());
+	
+	if (a.degree() < half_gcd_threshold) {
+		gcd_matrix<T> r = identity_gcd_matrix(a.leading());
+		while (b.degree() >= m) {
+			qr_pair<poly<T>> qr = a.divide(b);
+			r = euclid_step(r, qr.quotient);
+			a = b;
+			b = qr.remainder;
+		}
+		return r;
+	}
+	
+	poly<T> a_high = a;
+	poly<T> b_high = b;
+	a_high >>= m;
+	b_high >>= m;
+	gcd_matrix<T> r = half_gcd(a_high, b_high);
+	std::pair<poly<T>, poly<T>> ab = apply_gcd_matrix(r, a, b);
+	a = ab.first;
+	b = ab.second;
+	if (b.degree() < m)
+		return r;
+	
+	qr_pair<poly<T>> qr = a.divide(b);
+	r = euclid_step(r, qr.quotient);
+	a = b;
+	b = qr.remainder;
+	
+	int k = 2*m - a.degree();
+	a_high = a;
+	b_high = b;
+	a_high >>= k;
+	b_high >>= k;
+	return half_gcd(a_high, b_high) * r;
+}
+
+template <typename T>
+std::tuple<poly<T>, poly<T>, poly<T>> half_gcd_extended(poly<T> a, poly<T> b);
+
 template <typename T>
 std::tuple<poly<T>, poly<T>, poly<T>> extended_gcd(poly<T> a, poly<T> b) {
 	// Algorithm 3.2.2
+	// For large inputs we hand off to the half-GCD, which only comes back
+	// here once the degrees have dropped below the threshold.
+	
+	if (a.degree() >= half_gcd_threshold && b.degree() >= half_gcd_threshold)
+		return half_gcd_extended(a, b);
 	
 	if (b.degree() < 0)
 		return std::make_tuple(poly<T>(util<T>::one(a[a.degree()])), poly<T>(util<T>::zero(a[a.degree()])), a);
@@ -115,6 +218,42 @@ std::tuple<poly<T>, poly<T>, poly<T>> extended_gcd(poly<T> a, poly<T> b) {
 	return std::make_tuple(u, v, d);
 }
 
+template <typename T>
+std::tuple<poly<T>, poly<T>, poly<T>> half_gcd_extended(poly<T> a, poly<T> b) {
+	// Fast extended GCD over a field: returns (u, v, d) with u*a + v*b = d,
+	// exactly like extended_gcd, but using half_gcd to skip through
+	// the remainder sequence while the degrees are large.
+	
+	if (a.degree() < b.degree()) {
+		std::tuple<poly<T>, poly<T>, poly<T>> swapped = half_gcd_extended(b, a);
+		return std::make_tuple(std::get<1>(swapped), std::get<0>(swapped), std::get<2>(swapped));
+	}
+	
+	gcd_matrix<T> m = identity_gcd_matrix(a.leading());
+	while (b.degree() >= 0 && a.degree() >= half_gcd_threshold) {
+		if (2*b.degree() > a.degree()) {
+			gcd_matrix<T> s = half_gcd(a, b);
+			std::pair<poly<T>, poly<T>> ab = apply_gcd_matrix(s, a, b);
+			a = ab.first;
+			b = ab.second;
+			m = s * m;
+		}
+		else {
+			qr_pair<poly<T>> qr = a.divide(b);
+			m = euclid_step(m, qr.quotient);
+			a = b;
+			b = qr.remainder;
+		}
+	}
+	
+	// The rest is small enough for the classical loop.
+	// Note that (a, b) = m(a_0, b_0), so the cofactors compose with m.
+	std::tuple<poly<T>, poly<T>, poly<T>> tail = extended_gcd(a, b);
+	poly<T> u = std::get<0>(tail)*m.m11 + std::get<1>(tail)*m.m21;
+	poly<T> v = std::get<0>(tail)*m.m12 + std::get<1>(tail)*m.m22;
+	return std::make_tuple(u, v, std::get<2>(tail));
+}
+
 template <typename T>
 poly<T> util<poly<T>>::get_gcd(const poly<T> &a, const poly<T> &b) {
 	return std::get<2>(extended_gcd(a, b));
@@ -177,6 +316,11 @@ poly<T> sub_resultant_gcd(poly<T> a, poly<T> b) {
 	return (b/b.content()) * d;
 }
 
+template <typename T>
+poly<T> poly_gcd(poly<T> a, poly<T> b) {
+	return sub_resultant_gcd(a, b);
+}
+
 template <typename T>
 T sub_resultant(poly<T> a, poly<T> b) {
 	// Algorithm 3.3.7
@@ -198,11 +342,10 @@ T sub_resultant(poly<T> a, poly<T> b) {
 		poly<T> temp = a;
 		a = b;
 		b = temp;
+		if (a.degree() % 2 && b.degree() % 2)
+			s = -s;
 	}
 	
-	if (a.degree() % 2 && b.degree() % 2)
-		s = -s;
-	
 	do {
 		int delta = a.degree() - b.degree();
 		
@@ -235,98 +378,380 @@ T sub_resultant(poly<T> a, poly<T> b) {
 	return s*t*h2;
 }
 
+template <typename T>
+std::vector<std::pair<poly<T>, int>> squarefree_decomposition(poly<T> a) {
+	// Yun's algorithm, for fields of characteristic zero.
+	// Returns monic squarefree, pairwise coprime a_i with multiplicities i
+	// such that a = lc(a) * prod a_i^i.
+	
+	std::vector<std::pair<poly<T>, int>> result;
+	if (a.degree() < 1)
+		return result;
+	
+	poly<T> a_prime = a.derivative();
+	poly<T> a0 = poly_gcd(a, a_prime);
+	poly<T> b = a / a0;
+	poly<T> c = a_prime / a0;
+	poly<T> d = c - b.derivative();
+	
+	int i = 1;
+	while (b.degree() > 0) {
+		poly<T> ai = poly_gcd(b, d);
+		b = b / ai;
+		c = d / ai;
+		d = c - b.derivative();
+		if (ai.degree() > 0)
+			result.push_back(std::make_pair(ai * (util<T>::one(ai.leading())/ai.leading()), i));
+		i++;
+	}
+	
+	return result;
+}
+
+std::vector<std::pair<Z_X, int>> squarefree_decomposition(Z_X a);
+std::vector<std::pair<ZN_X, int>> squarefree_decomposition(ZN_X a);
+
 std::vector<ZN_X> berlekamp_small_p(ZN_X a);
 std::vector<ZN_X> berlekamp(ZN_X a);
 std::vector<ZN_X> berlekamp_auto(ZN_X a);
 
 Z coeff_bound(Z_X a);
+Z factoring_prime(Z_X u);
 
 std::pair<Z_X, Z_X> hensel_lift(Z p, Z q, Z_X a, Z_X b, Z_X c, Z_X u, Z_X v);
 std::pair<Z_X, Z_X> quad_hensel_lift(Z p, Z q, Z_X a1, Z_X b1, Z_X u, Z_X v);
 std::pair<Z_X, Z_X> multi_hensel_lift(Z p, int exp, Z_X a, Z_X b, Z_X c);
 std::vector<Z_X> poly_hensel_lift(Z p, int exp, std::vector<Z_X> ai, Z_X c);
 
+std::vector<std::vector<Z>> lll_reduce(std::vector<std::vector<Z>> b);
+
+template <typename T>
+poly<T> inflate(poly<T> f, int k) {
+	// Returns f(x^k)
+	if (f.degree() < 0)
+		return f;
+	std::vector<T> coeffs(f.degree()*k + 1, util<T>::zero(f.leading()));
+	for (int i = 0; i <= f.degree(); i++)
+		coeffs[i*k] = f[i];
+	return poly<T>(coeffs);
+}
+
+template <typename T>
+poly<T> negate_variable(poly<T> f) {
+	// Returns f(-x)
+	for (int i = 1; i <= f.degree(); i += 2)
+		f.set(i, -f[i]);
+	return f;
+}
+
+template <typename T>
+poly<T> graeffe(poly<T> f) {
+	// Graeffe's root squaring: writing f(x) = e(x^2) + x o(x^2),
+	// g = (-1)^n (e^2 - x o^2) satisfies g(x^2) = (-1)^n f(x) f(-x),
+	// so the roots of g are the squares of the roots of f.
+	std::vector<T> even, odd;
+	for (int i = 0; i <= f.degree(); i++) {
+		if (i % 2)
+			odd.push_back(f[i]);
+		else
+			even.push_back(f[i]);
+	}
+	poly<T> e(even), o(odd);
+	poly<T> xo2 = o*o;
+	xo2 <<= 1;
+	poly<T> g = e*e - xo2;
+	if (f.degree() % 2)
+		g = -g;
+	return g;
+}
+
+Z_X poly_gcd(Z_X a, Z_X b);
+ZN_X poly_gcd(ZN_X a, ZN_X b);
+
+const int modular_gcd_max_primes = 200;
+
+bool rational_reconstruction(Z a, Z m, Q &result);
+poly<polymod<Q>> modular_gcd(poly<polymod<Q>> a, poly<polymod<Q>> b);
+poly<polymod<Q>> poly_gcd(poly<polymod<Q>> a, poly<polymod<Q>> b);
+
+template <typename T>
+poly<T> odd_cyclotomic_part(poly<T> f) {
+	// Returns the product of the Phi_n dividing f with n odd; f must be
+	// squarefree with f(0) != 0.
+	// Squaring permutes the primitive n-th roots of unity when n is odd, so
+	// those factors survive every step of h -> gcd(h, graeffe(h)). Once h
+	// divides graeffe(h), squaring maps the roots of h onto themselves, so
+	// every root of h is periodic under squaring, i.e. a root of unity of
+	// odd order.
+	poly<T> h = f;
+	while (h.degree() > 0) {
+		poly<T> g = poly_gcd(h, graeffe(h));
+		if (g.degree() == h.degree())
+			break;
+		h = g;
+	}
+	return h;
+}
+
+template <typename T>
+poly<T> even_cyclotomic_part(poly<T> f) {
+	// Returns the product of the Phi_n dividing f with n even.
+	// For n = 2m with m odd, Phi_n(x) = +-Phi_m(-x). For 4 | n,
+	// Phi_n(x) = Phi_(n/2)(x^2), and an even polynomial divides
+	// f(x) = e(x^2) + x o(x^2) exactly when it divides both parts,
+	// so those factors come from the even cyclotomic part of gcd(e, o).
+	poly<T> h = negate_variable(odd_cyclotomic_part(negate_variable(f)));
+	
+	std::vector<T> even, odd;
+	for (int i = 0; i <= f.degree(); i++) {
+		if (i % 2)
+			odd.push_back(f[i]);
+		else
+			even.push_back(f[i]);
+	}
+	poly<T> g = poly_gcd(poly<T>(even), poly<T>(odd));
+	if (g.degree() > 0)
+		h *= inflate(even_cyclotomic_part(g), 2);
+	return h;
+}
+
+template <typename T>
+struct composition_pair {
+	public:
+		poly<T> outer;
+		poly<T> inner;
+};
+
+template <typename T>
+int deflation(poly<T> f) {
+	// Returns the largest k such that f is a polynomial in x^k
+	int k = 0;
+	for (int i = 1; i <= f.degree(); i++) {
+		if (f[i] == util<T>::zero(f[i]))
+			continue;
+		int a = i, b = k;
+		while (b) {
+			int t = a % b;
+			a = b;
+			b = t;
+		}
+		k = a;
+	}
+	return k;
+}
+
+template <typename T>
+poly<T> deflate(poly<T> f, int k) {
+	// Returns g with g(x^k) = f; f must be a polynomial in x^k
+	std::vector<T> coeffs;
+	for (int i = 0; i <= f.degree(); i += k)
+		coeffs.push_back(f[i]);
+	return poly<T>(coeffs);
+}
+
+template <typename T>
+composition_pair<T> decompose(poly<T> f, int s) {
+	// Kozen-Landau decomposition over a field of characteristic zero.
+	// Looks for f = g(h) with deg(h) = s, h monic and h(0) = 0; if there is
+	// such a decomposition it is unique. If there isn't, the outer
+	// polynomial of the result is zero.
+	// Since f - lc(f) h^r has degree at most n - s, the top s coefficients
+	// of f determine h: reversing, y^s h(1/y) = (y^n f(1/y) / lc(f))^(1/r)
+	// mod y^s. Then the coefficients of g are the digits of the h-adic
+	// expansion of f, which must all be constants.
+	
+	composition_pair<T> result;
+	int n = f.degree();
+	if (s < 1 || n % s)
+		return result;
+	int r = n / s;
+	
+	T lc = f.leading();
+	T one = util<T>::one(lc);
+	T alpha = one / util<T>::from_int(r, lc);
+	
+	// F = reversed monic f, G = F^(1/r), both mod y^s.
+	// From F G' = alpha F' G, with F_0 = G_0 = 1:
+	// m G_m = sum_(k=1)^m (alpha k - (m - k)) F_k G_(m-k)
+	std::vector<T> big_f, big_g;
+	for (int i = 0; i < s; i++)
+		big_f.push_back(f[n - i] / lc);
+	big_g.push_back(one);
+	for (int m = 1; m < s; m++) {
+		T sum = util<T>::zero(lc);
+		for (int k = 1; k <= m; k++)
+			sum += (alpha*util<T>::from_int(k, lc) - util<T>::from_int(m - k, lc)) * big_f[k] * big_g[m - k];
+		big_g.push_back(sum / util<T>::from_int(m, lc));
+	}
+	
+	std::vector<T> h_coeffs;
+	h_coeffs.push_back(util<T>::zero(lc));
+	for (int i = s - 1; i >= 0; i--)
+		h_coeffs.push_back(big_g[i]);
+	poly<T> h(h_coeffs);
+	
+	std::vector<T> g_coeffs;
+	poly<T> rest = f;
+	for (int j = 0; j <= r; j++) {
+		qr_pair<poly<T>> qr = rest.divide(h);
+		if (qr.remainder.degree() > 0)
+			return result;
+		g_coeffs.push_back(qr.remainder[0]);
+		rest = qr.quotient;
+	}
+	if (rest.degree() >= 0)
+		return result;
+	
+	result.outer = poly<T>(g_coeffs);
+	result.inner = h;
+	return result;
+}
+
+std::vector<Z_X> decomposition_factors(Z_X u);
+
+int euler_phi(int n);
+Z_X cyclotomic(int n);
+
+std::vector<Z_X> binomial_factors(Z_X u);
+std::vector<Z_X> cyclotomic_factors(Z_X u);
+std::vector<Z_X> linear_factors(Z_X u);
+std::vector<Z_X> factor_squarefree(Z_X u);
 std::vector<Z_X> factor(Z_X a);
 std::vector<Q_X> factor(Q_X a);
 
 template <typename T>
-std::vector<poly<polymod<T>>> factor(poly<polymod<T>> a) {
-	// Algorithm 3.6.4
-	// Note that 3.6.4 assumes Q as the base field;
-	// other number fields will also work.
+std::vector<T> batch_inverse(const std::vector<T> &a) {
+	// Montgomery's trick: inverts every element of a with one inversion
+	// and 3(n - 1) multiplications. The elements must all be nonzero.
 	
-	if (a.degree() < 0)
-		return std::vector<poly<polymod<T>>>({a});
-
-	poly<polymod<T>> u = a / sub_resultant_gcd(a, a.derivative());
+	std::vector<T> result(a);
+	if (a.empty())
+		return result;
 	
-	// std::cout << "u = " << u << std::endl;
+	std::vector<T> prefix;
+	prefix.push_back(a[0]);
+	for (int i = 1; i < a.size(); i++)
+		prefix.push_back(prefix[i - 1] * a[i]);
+	
+	T inverse = prefix.back().inv();
+	for (int i = a.size() - 1; i > 0; i--) {
+		result[i] = inverse * prefix[i - 1];
+		inverse *= a[i];
+	}
+	result[0] = inverse;
+	return result;
+}
 
+template <typename T>
+poly<T> trager_norm(poly<polymod<T>> u, T k) {
+	// Returns Res_y(T(y), u(x - ky, y)), where T is the modulus of the
+	// coefficients of u, i.e. the norm of u(x - k alpha) up to a power of
+	// the leading coefficient of T.
+	
 	std::vector<poly<T>> gs;
 	for (int i = 0; i <= u.degree(); i++)
-		gs.push_back(u[i]);
+		gs.push_back(u[i].get_value());
 	poly<poly<T>> g(gs);
 	
-	T k = util<T>::zero(a.leading().get_value().leading());
+	poly<poly<T>> gxkyy = switch_variables(g.taylor_shift(poly<T>({util<T>::zero(k), -k})));
+	poly<poly<T>> ty = switch_variables(poly<poly<T>>(u.leading().get_base()));
+	return sub_resultant(ty, gxkyy);
+}
+
+Q_X trager_norm(poly<polymod<Q>> u, Q k);
+
+template <typename T>
+int norm_squarefree_hint(poly<polymod<T>> u, T k) {
+	// Returns 1 if trager_norm(u, k) is known to be squarefree, 0 if it
+	// probably isn't, and -1 if there's no cheap way to tell
+	return -1;
+}
+
+int norm_squarefree_hint(poly<polymod<Q>> u, Q k);
+
+template <typename T>
+std::vector<poly<polymod<T>>> factor_squarefree(poly<polymod<T>> u) {
+	// Algorithm 3.6.4
+	// Note that 3.6.4 assumes Q as the base field;
+	// other number fields will also work.
+	// Here u must already be squarefree; factor() takes care of that.
+	
+	T k = util<T>::zero(u.leading().get_value().leading());
 	
 	poly<T> n;
 	
 	while (true) {
-		poly<poly<T>> xky = poly<poly<T>>({poly<T>({util<T>::zero(k), -k}), poly<T>(util<T>::one(k))});
-		poly<poly<T>> gxkyy = switch_variables(g.compose(xky));
-		poly<poly<T>> ty = switch_variables(poly<poly<T>>(a.leading().get_base()));
-		n = sub_resultant(ty, gxkyy);
-		if (sub_resultant_gcd(n, n.derivative()).degree() == 0)
-			break;
-		k += util<T>::one(a.leading().get_value().leading());
+		int hint = norm_squarefree_hint(u, k);
+		if (hint != 0) {
+			n = trager_norm(u, k);
+			if (hint == 1 || sub_resultant_gcd(n, n.derivative()).degree() == 0)
+				break;
+		}
+		k += util<T>::one(u.leading().get_value().leading());
 	}
 	
 	// std::cout << "k = " << k << std::endl;
 	// std::cout << "n = " << n << std::endl;
 	
 	std::vector<poly<T>> ni = factor(n);
-	std::vector<poly<polymod<T>>> result;
-	
-	// std::cout << "= ";
-	
-	// for (int i = 0; i < ni.size(); i++)
-	// 	std::cout << ni[i];
-	
-	// std::cout << std::endl;
-	
-	for (int i = 0; i < ni.size(); i++) {
+	// The gcds for different n_i are independent, so they are computed
+	// concurrently and collected afterwards in the order of ni.
+	std::vector<poly<polymod<T>>> ai(ni.size());
+	parallel_for(ni.size(), [&](int i) {
 		std::vector<polymod<T>> nilist;
 		for (int j = 0; j <= ni[i].degree(); j++)
-			nilist.push_back(polymod<T>(a.leading().get_base(), ni[i][j]));
+			nilist.push_back(polymod<T>(u.leading(), ni[i][j]));
 		poly<polymod<T>> niconv(nilist);
 		
 		poly<polymod<T>> nixkt = niconv.compose(poly<polymod<T>>({
-				polymod<T>(a.leading(), poly<T>(k))*polymod<T>(a.leading(), poly<T>({util<T>::zero(a.leading().get_value().leading()),
-				util<T>::one(a.leading().get_value().leading())})), util<polymod<T>>::one(a.leading())
+				polymod<T>(u.leading(), poly<T>(k))*polymod<T>(u.leading(), poly<T>({util<T>::zero(u.leading().get_value().leading()),
+				util<T>::one(u.leading().get_value().leading())})), util<polymod<T>>::one(u.leading())
 			}));
-		poly<polymod<T>> ai = sub_resultant_gcd(u, nixkt);
+		ai[i] = poly_gcd(u, nixkt);
 		
 		// std::cout << "n_i = " << niconv << std::endl;
-		// std::cout << "x + kt = " << poly<polymod<T>>({
-		// 		polymod<T>(a.leading(), poly<T>(k))*polymod<T>(a.leading(), poly<T>({util<T>::zero(a.leading().get_value().leading()),
-		// 		util<T>::one(a.leading().get_value().leading())})), util<polymod<T>>::one(a.leading())
-		// 	}) << std::endl;
 		// std::cout << "n_i(x + kt) = " << nixkt << std::endl;
-		// std::cout << "a_i = " << ai << std::endl;
-		
-		if (ai.degree() < 1)
+		// std::cout << "a_i = " << ai[i] << std::endl;
+	});
+	
+	// Make the factors monic, inverting all the leading coefficients at once
+	std::vector<poly<polymod<T>>> result;
+	std::vector<polymod<T>> leading;
+	for (int i = 0; i < ai.size(); i++) {
+		if (ai[i].degree() < 1)
 			continue;
 		
-		poly<polymod<T>> a_temp = a;
-		while (true) {
-			// std::cout << a_temp << std::endl;
-			qr_pair<poly<polymod<T>>> qr = a_temp.divide(ai);
-			if (qr.remainder.degree() >= 0)
-				break;
-			// std::cout << "divides!" << std::endl;
-			a_temp = qr.quotient;
-			result.push_back(ai / ai.leading());
-		}
+		result.push_back(ai[i]);
+		leading.push_back(ai[i].leading());
+	}
+	std::vector<polymod<T>> inverses = batch_inverse(leading);
+	for (int i = 0; i < result.size(); i++)
+		result[i] *= inverses[i];
+	
+	return result;
+}
+
+// How many primes to look through for one where the modulus has a root
+const int padic_factor_max_primes = 300;
+
+bool padic_factor_squarefree(poly<polymod<Q>> u, std::vector<poly<polymod<Q>>> &result);
+std::vector<poly<polymod<Q>>> factor_squarefree(poly<polymod<Q>> u);
+
+template <typename T>
+std::vector<poly<polymod<T>>> factor(poly<polymod<T>> a) {
+	// Split a into squarefree parts with Yun's algorithm, so that each
+	// factor comes out with its multiplicity and no trial division is needed.
+	
+	if (a.degree() < 0)
+		return std::vector<poly<polymod<T>>>({a});
+	
+	std::vector<poly<polymod<T>>> result;
+	std::vector<std::pair<poly<polymod<T>>, int>> parts = squarefree_decomposition(a);
+	for (int i = 0; i < parts.size(); i++) {
+		std::vector<poly<polymod<T>>> factors = factor_squarefree(parts[i].first);
+		for (int j = 0; j < factors.size(); j++)
+			for (int e = 0; e < parts[i].second; e++)
+				result.push_back(factors[j]);
 	}
 	
 	result.push_back(poly<polymod<T>>(a.leading()));
@@ -334,4 +759,38 @@ std::vector<poly<polymod<T>>> factor(poly<polymod<T>> a) {
 }
 
 std::vector<poly<numberfield>> factor(poly<numberfield> a);
-std::vector<C> find_complex_roots(Q_X p_q, int precision);
\ No newline at end of file
+// How many sweeps find_complex_roots_aberth makes before giving up on
+// the iteration and handing the polynomial to find_complex_roots
+const int aberth_max_iterations = 500;
+
+// How many mpf Newton steps find_complex_roots allows for polishing a
+// double precision root before falling back to mpf throughout
+const int root_polish_max_iterations = 50;
+
+// How many points evaluate_with_derivative_batch evaluates together; 8
+// doubles fill an AVX-512 register, or two AVX2 ones
+const int horner_batch_lanes = 8;
+
+// The overloads without a precision_context work at mpf's default
+// precision, read once by the calling thread. A single polynomial is
+// polished on the calling thread unless more threads are asked for; the
+// batch overloads use every core by default (threads = 0).
+std::vector<C> find_complex_roots(Q_X p_q, int precision, unsigned int threads = 1);
+std::vector<C> find_complex_roots(Q_X p_q, int precision, const precision_context &context, unsigned int threads = 1);
+std::vector<std::vector<C>> find_complex_roots(const std::vector<Q_X> &polys, int precision, unsigned int threads = 0);
+std::vector<std::vector<C>> find_complex_roots(const std::vector<Q_X> &polys, int precision, const precision_context &context, unsigned int threads = 0);
+std::vector<C> find_complex_roots_aberth(Q_X p_q, int precision);
+std::vector<C> find_complex_roots_aberth(Q_X p_q, int precision, const precision_context &context);
+void evaluate_with_derivative_batch(const std::vector<std::complex<double>> &p, const std::vector<std::complex<double>> &x, std::vector<std::complex<double>> &values, std::vector<std::complex<double>> &slopes);
+
+struct real_root_interval {
+	// The open interval (lower, upper) holds exactly one real root, or
+	// lower == upper is itself a rational root
+	public:
+		Q lower, upper;
+};
+
+std::vector<real_root_interval> isolate_real_roots(Z_X p);
+std::vector<real_root_interval> isolate_real_roots(Q_X p);
+real_root_interval refine_real_root(Z_X p, real_root_interval interval, Q width);
+real_root_interval refine_real_root(Q_X p, real_root_interval interval, Q width);
\ No newline at end of file
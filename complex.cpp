@@ -1,5 +1,47 @@
+#include <algorithm>
+#include <cmath>
+
 #include "complex.h"
 
+class complex_scratch {
+	// Temporaries for the in-place kernels, one set per thread. Their
+	// allocation only ever grows; each use just sets the working precision
+	// with mpf_set_prec_raw, so once warm the kernels never touch the heap.
+	
+	private:
+		mpf_t t[6];
+		mp_bitcnt_t capacity;
+		
+	public:
+		complex_scratch() {
+			this->capacity = 64;
+			for (int i = 0; i < 6; i++)
+				mpf_init2(this->t[i], this->capacity);
+		}
+		
+		~complex_scratch() {
+			for (int i = 0; i < 6; i++) {
+				mpf_set_prec_raw(this->t[i], this->capacity);
+				mpf_clear(this->t[i]);
+			}
+		}
+		
+		mpf_t *get(mp_bitcnt_t prec) {
+			if (prec > this->capacity) {
+				for (int i = 0; i < 6; i++) {
+					mpf_set_prec_raw(this->t[i], this->capacity);
+					mpf_set_prec(this->t[i], prec);
+				}
+				this->capacity = prec;
+			}
+			for (int i = 0; i < 6; i++)
+				mpf_set_prec_raw(this->t[i], prec);
+			return this->t;
+		}
+};
+
+static thread_local complex_scratch scratch;
+
 complex::complex() {
 	this->real = 0;
 	this->imag = 0;
@@ -10,19 +52,13 @@ complex::complex(int real) {
 	this->real = mpf_class(real);
 }
 
-complex::complex(mpf_class real) {
-	this->imag = 0;
-	this->real = real;
+complex::complex(mpf_class real) : real(real), imag(0, real.get_prec()) {
 }
 
-complex::complex(mpf_class real, mpf_class imag) {
-	this->real = real;
-	this->imag = imag;
+complex::complex(mpf_class real, mpf_class imag) : real(real), imag(imag) {
 }
 
-complex::complex(const complex &other) {
-	this->real = other.real;
-	this->imag = other.imag;
+complex::complex(const complex &other) : real(other.real), imag(other.imag) {
 }
 
 mpf_class complex::get_real() const {
@@ -33,13 +69,35 @@ mpf_class complex::get_imag() const {
 	return this->imag;
 }
 
+mp_bitcnt_t complex::get_prec() const {
+	return std::max(this->real.get_prec(), this->imag.get_prec());
+}
+
+void complex::set_prec(mp_bitcnt_t prec) {
+	if (this->real.get_prec() != prec)
+		this->real.set_prec(prec);
+	if (this->imag.get_prec() != prec)
+		this->imag.set_prec(prec);
+}
+
+void complex::raise_prec(const complex &other) {
+	mp_bitcnt_t prec = other.get_prec();
+	if (prec > this->get_prec())
+		this->set_prec(prec);
+}
+
 complex &complex::operator=(mpf_class value) {
+	this->set_prec(value.get_prec());
 	this->real = value;
 	this->imag = 0;
 	return *this;
 }
 
 complex &complex::operator=(const complex &other) {
+	if (this->real.get_prec() != other.real.get_prec())
+		this->real.set_prec(other.real.get_prec());
+	if (this->imag.get_prec() != other.imag.get_prec())
+		this->imag.set_prec(other.imag.get_prec());
 	this->real = other.real;
 	this->imag = other.imag;
 	return *this;
@@ -54,26 +112,82 @@ bool complex::operator!=(const complex &other) const {
 }
 
 complex &complex::operator+=(const complex &other) {
+	this->raise_prec(other);
 	this->real += other.real;
 	this->imag += other.imag;
 	return *this;
 }
 
 complex &complex::operator-=(const complex &other) {
+	this->raise_prec(other);
 	this->real -= other.real;
 	this->imag -= other.imag;
 	return *this;
 }
 
+void complex::multiply_parts(mpf_srcptr c, mpf_srcptr d, mpf_t *t) const {
+	// (real + imag i)(c + di) into t[0] + t[1] i, using t[2] and t[3]
+	mpf_srcptr a = this->real.get_mpf_t(), b = this->imag.get_mpf_t();
+	if (this->get_prec() >= gauss_multiply_threshold) {
+		// k1 = c(a + b), k2 = a(d - c), k3 = b(c + d) give
+		// ac - bd = k1 - k3 and ad + bc = k1 + k2
+		mpf_add(t[0], a, b);
+		mpf_mul(t[0], t[0], c);
+		mpf_sub(t[1], d, c);
+		mpf_mul(t[1], t[1], a);
+		mpf_add(t[2], c, d);
+		mpf_mul(t[2], t[2], b);
+		mpf_add(t[1], t[0], t[1]);
+		mpf_sub(t[0], t[0], t[2]);
+	}
+	else {
+		mpf_mul(t[0], a, c);
+		mpf_mul(t[1], b, d);
+		mpf_mul(t[2], a, d);
+		mpf_mul(t[3], b, c);
+		mpf_sub(t[0], t[0], t[1]);
+		mpf_add(t[1], t[2], t[3]);
+	}
+}
+
 complex &complex::operator*=(const complex &other) {
-	mpf_class temp = this->real;
-	this->real = this->real * other.real - this->imag * other.imag;
-	this->imag = temp * other.imag + this->imag * other.real;
+	this->raise_prec(other);
+	mpf_t *t = scratch.get(this->get_prec());
+	this->multiply_parts(other.real.get_mpf_t(), other.imag.get_mpf_t(), t);
+	mpf_set(this->real.get_mpf_t(), t[0]);
+	mpf_set(this->imag.get_mpf_t(), t[1]);
 	return *this;
 }
 
 complex &complex::operator/=(const complex &other) {
-	return (*this) *= other.inv();
+	// Multiplies by the conjugate and then by 1/|other|^2, so there is a
+	// single division
+	this->raise_prec(other);
+	mpf_t *t = scratch.get(this->get_prec());
+	mpf_srcptr c = other.real.get_mpf_t(), d = other.imag.get_mpf_t();
+	mpf_mul(t[5], c, c);
+	mpf_mul(t[4], d, d);
+	mpf_add(t[5], t[5], t[4]);
+	mpf_ui_div(t[5], 1, t[5]);
+	mpf_neg(t[4], d);
+	this->multiply_parts(c, t[4], t);
+	mpf_mul(this->real.get_mpf_t(), t[0], t[5]);
+	mpf_mul(this->imag.get_mpf_t(), t[1], t[5]);
+	return *this;
+}
+
+complex &complex::multiply_add(const complex &x, const complex &c) {
+	this->raise_prec(x);
+	this->raise_prec(c);
+	mpf_t *t = scratch.get(this->get_prec());
+	this->multiply_parts(x.real.get_mpf_t(), x.imag.get_mpf_t(), t);
+	mpf_add(this->real.get_mpf_t(), t[0], c.real.get_mpf_t());
+	mpf_add(this->imag.get_mpf_t(), t[1], c.imag.get_mpf_t());
+	return *this;
+}
+
+void multiply_add(complex &acc, const complex &x, const complex &c) {
+	acc.multiply_add(x, c);
 }
 
 complex complex::operator+(const complex &other) const {
@@ -97,10 +211,17 @@ complex complex::operator-() const {
 }
 
 complex complex::inv() const {
-	return complex(
-		this->real / (this->real*this->real + this->imag*this->imag),
-		-this->imag / (this->real*this->real + this->imag*this->imag)
-	);
+	complex result(*this);
+	mpf_t *t = scratch.get(this->get_prec());
+	mpf_srcptr a = this->real.get_mpf_t(), b = this->imag.get_mpf_t();
+	mpf_mul(t[0], a, a);
+	mpf_mul(t[1], b, b);
+	mpf_add(t[0], t[0], t[1]);
+	mpf_ui_div(t[0], 1, t[0]);
+	mpf_mul(result.real.get_mpf_t(), a, t[0]);
+	mpf_mul(result.imag.get_mpf_t(), b, t[0]);
+	mpf_neg(result.imag.get_mpf_t(), result.imag.get_mpf_t());
+	return result;
 }
 
 complex complex::conjugate() const {
@@ -108,7 +229,127 @@ complex complex::conjugate() const {
 }
 
 mpf_class complex::norm() const {
-	return ((*this) * this->conjugate()).get_real();
+	mpf_class result(0, this->get_prec());
+	mpf_t *t = scratch.get(this->get_prec());
+	mpf_mul(result.get_mpf_t(), this->real.get_mpf_t(), this->real.get_mpf_t());
+	mpf_mul(t[0], this->imag.get_mpf_t(), this->imag.get_mpf_t());
+	mpf_add(result.get_mpf_t(), result.get_mpf_t(), t[0]);
+	return result;
+}
+
+static dd_real quick_two_sum(double a, double b) {
+	// Requires |a| >= |b|
+	double s = a + b;
+	return dd_real(s, b - (s - a));
+}
+
+static dd_real two_sum(double a, double b) {
+	double s = a + b;
+	double v = s - a;
+	return dd_real(s, (a - (s - v)) + (b - v));
+}
+
+dd_real::dd_real() {
+	this->hi = 0;
+	this->lo = 0;
+}
+
+dd_real::dd_real(double hi) {
+	this->hi = hi;
+	this->lo = 0;
+}
+
+dd_real::dd_real(double hi, double lo) {
+	this->hi = hi;
+	this->lo = lo;
+}
+
+dd_real::dd_real(const mpf_class &value) {
+	double hi = value.get_d();
+	double lo = mpf_class(value - hi).get_d();
+	*this = quick_two_sum(hi, lo);
+}
+
+mpf_class dd_real::to_mpf(mp_bitcnt_t prec) const {
+	mpf_class result(this->hi, prec);
+	result += this->lo;
+	return result;
+}
+
+dd_real dd_real::operator+(const dd_real &other) const {
+	dd_real s = two_sum(this->hi, other.hi);
+	dd_real t = two_sum(this->lo, other.lo);
+	s = quick_two_sum(s.hi, s.lo + t.hi);
+	return quick_two_sum(s.hi, s.lo + t.lo);
+}
+
+dd_real dd_real::operator-(const dd_real &other) const {
+	return (*this) + (-other);
+}
+
+dd_real dd_real::operator*(const dd_real &other) const {
+	double p = this->hi * other.hi;
+	double e = std::fma(this->hi, other.hi, -p);
+	e += this->hi * other.lo + this->lo * other.hi;
+	return quick_two_sum(p, e);
+}
+
+dd_real dd_real::operator/(const dd_real &other) const {
+	// Long division, one double of quotient at a time
+	double q1 = this->hi / other.hi;
+	dd_real r = (*this) - other * dd_real(q1);
+	double q2 = r.hi / other.hi;
+	r = r - other * dd_real(q2);
+	double q3 = r.hi / other.hi;
+	return quick_two_sum(q1, q2) + dd_real(q3);
+}
+
+dd_real dd_real::operator-() const {
+	return dd_real(-this->hi, -this->lo);
+}
+
+dd_complex::dd_complex() {
+}
+
+dd_complex::dd_complex(dd_real real, dd_real imag) {
+	this->real = real;
+	this->imag = imag;
+}
+
+dd_complex::dd_complex(const complex &value) {
+	this->real = dd_real(value.get_real());
+	this->imag = dd_real(value.get_imag());
+}
+
+complex dd_complex::to_complex(mp_bitcnt_t prec) const {
+	return complex(this->real.to_mpf(prec), this->imag.to_mpf(prec));
+}
+
+dd_complex dd_complex::operator+(const dd_complex &other) const {
+	return dd_complex(this->real + other.real, this->imag + other.imag);
+}
+
+dd_complex dd_complex::operator-(const dd_complex &other) const {
+	return dd_complex(this->real - other.real, this->imag - other.imag);
+}
+
+dd_complex dd_complex::operator*(const dd_complex &other) const {
+	return dd_complex(
+		this->real * other.real - this->imag * other.imag,
+		this->real * other.imag + this->imag * other.real
+	);
+}
+
+dd_complex dd_complex::operator/(const dd_complex &other) const {
+	dd_real d = other.real * other.real + other.imag * other.imag;
+	return dd_complex(
+		(this->real * other.real + this->imag * other.imag) / d,
+		(this->imag * other.real - this->real * other.imag) / d
+	);
+}
+
+double dd_complex::abs() const {
+	return std::hypot(this->real.hi, this->imag.hi);
 }
 
 std::ostream &operator<<(std::ostream &os, const complex &m) {
@@ -120,13 +361,38 @@ complex util<complex>::zero() {
 }
 
 complex util<complex>::zero(const complex &reference) {
-	return complex(0, 0);
+	return from_int(0, reference);
 }
 
 complex util<complex>::one(const complex &reference) {
-	return complex(1, 0);
+	return from_int(1, reference);
 }
 
 complex util<complex>::from_int(int n, const complex &reference) {
-	return complex(n, 0);
-}
\ No newline at end of file
+	mp_bitcnt_t prec = reference.get_prec();
+	return complex(mpf_class(n, prec), mpf_class(0, prec));
+}
+
+precision_context::precision_context(mp_bitcnt_t bits) {
+	this->bits = bits;
+}
+
+precision_context precision_context::from_default() {
+	return precision_context(mpf_get_default_prec());
+}
+
+mpf_class precision_context::to_real(double value) const {
+	return mpf_class(value, this->bits);
+}
+
+mpf_class precision_context::to_real(const mpq_class &value) const {
+	return mpf_class(value, this->bits);
+}
+
+complex precision_context::to_complex(double real, double imag) const {
+	return complex(this->to_real(real), this->to_real(imag));
+}
+
+complex precision_context::to_complex(const mpq_class &value) const {
+	return complex(this->to_real(value), this->to_real(0.0));
+}
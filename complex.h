@@ -9,10 +9,22 @@
 
 #pragma once
 
+// From this many bits of precision, complex products use Gauss's three
+// real multiplications instead of four; below it the extra additions
+// cost more than the multiplication they save.
+const int gauss_multiply_threshold = 512;
+
 class complex {
+	// The parts carry their own precision: a copy or assignment takes the
+	// precision of its source, and arithmetic keeps the higher precision
+	// of its operands. Only complex() and complex(int) use mpf's default.
+	
 	private:
 		mpf_class real, imag;
 		
+		void raise_prec(const complex &other);
+		void multiply_parts(mpf_srcptr c, mpf_srcptr d, mpf_t *t) const;
+		
 	public:
 		complex();
 		complex(int real);
@@ -22,6 +34,8 @@ class complex {
 		
 		mpf_class get_real() const;
 		mpf_class get_imag() const;
+		mp_bitcnt_t get_prec() const;
+		void set_prec(mp_bitcnt_t prec);
 		
 		complex &operator=(mpf_class value);
 		complex &operator=(const complex &other);
@@ -42,6 +56,9 @@ class complex {
 		complex operator-() const;
 		complex inv() const;
 		
+		// *this = *this * x + c, the step of Horner's rule
+		complex &multiply_add(const complex &x, const complex &c);
+		
 		complex conjugate() const;
 		mpf_class norm() const;
 		
@@ -49,6 +66,67 @@ class complex {
 
 };
 
+void multiply_add(complex &acc, const complex &x, const complex &c);
+
+class dd_real {
+	// A double-double: the unevaluated sum hi + lo of two doubles with
+	// |lo| at most half an ulp of hi, good for about 32 significant digits
+	// at close to hardware speed
+	
+	public:
+		double hi, lo;
+		
+		dd_real();
+		dd_real(double hi);
+		dd_real(double hi, double lo);
+		explicit dd_real(const mpf_class &value);
+		
+		mpf_class to_mpf(mp_bitcnt_t prec) const;
+		
+		dd_real operator+(const dd_real &other) const;
+		dd_real operator-(const dd_real &other) const;
+		dd_real operator*(const dd_real &other) const;
+		dd_real operator/(const dd_real &other) const;
+		dd_real operator-() const;
+};
+
+class dd_complex {
+	public:
+		dd_real real, imag;
+		
+		dd_complex();
+		dd_complex(dd_real real, dd_real imag);
+		explicit dd_complex(const complex &value);
+		
+		complex to_complex(mp_bitcnt_t prec) const;
+		
+		dd_complex operator+(const dd_complex &other) const;
+		dd_complex operator-(const dd_complex &other) const;
+		dd_complex operator*(const dd_complex &other) const;
+		dd_complex operator/(const dd_complex &other) const;
+		
+		// |z| from the leading parts only
+		double abs() const;
+};
+
+class precision_context {
+	// A working precision for R and C, in bits. Values made through a
+	// context carry its precision instead of reading mpf's process-wide
+	// default, so jobs at different precisions can run side by side
+	// without calling mpf_set_default_prec.
+	
+	public:
+		mp_bitcnt_t bits;
+		
+		explicit precision_context(mp_bitcnt_t bits);
+		static precision_context from_default();
+		
+		mpf_class to_real(double value) const;
+		mpf_class to_real(const mpq_class &value) const;
+		complex to_complex(double real, double imag) const;
+		complex to_complex(const mpq_class &value) const;
+};
+
 template <>
 class util<complex> {
 public:
@@ -1,4 +1,7 @@
+#include <mutex>
+
 #include "numberfield.h"
+#include "alg.h"
 
 void numberfield_error() {
 	std::cout << "Error: crossed the levels of nesting" << std::endl;
@@ -6,94 +9,175 @@ void numberfield_error() {
 	k /= (k - k);
 }
 
+std::shared_ptr<const numberfield_descriptor> numberfield_descriptor::get(const poly<numberfield> &modulus) {
+	// Descriptors are interned, so that elements of the same field
+	// can be recognized by comparing pointers
+
+	static std::mutex registry_mutex;
+	static std::vector<std::weak_ptr<const numberfield_descriptor>> registry;
+
+	std::shared_ptr<const numberfield_descriptor> base;
+	for (int i = 0; i <= modulus.degree(); i++) {
+		std::shared_ptr<const numberfield_descriptor> coeff_field = modulus[i].get_field();
+		if (coeff_field && (!base || coeff_field->depth > base->depth))
+			base = coeff_field;
+	}
+
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	for (int i = 0; i < registry.size(); i++) {
+		std::shared_ptr<const numberfield_descriptor> field = registry[i].lock();
+		if (!field) {
+			registry.erase(registry.begin() + i);
+			i--;
+			continue;
+		}
+		if (field->base == base && field->modulus == modulus)
+			return field;
+	}
+
+	std::shared_ptr<numberfield_descriptor> field(new numberfield_descriptor());
+	field->modulus = modulus;
+	field->base = base;
+	field->depth = base ? base->depth + 1 : 1;
+	registry.push_back(field);
+	return field;
+}
+
 numberfield::numberfield() {
-	this->is_valid = 0;
 }
 
 numberfield::numberfield(const mpq_class &value) {
-	this->is_valid = 1;
-	this->is_poly_value = 0;
-	this->rational_value = std::unique_ptr<mpq_class>(new mpq_class(value));
+	this->rational_value = value;
 }
 
 numberfield::numberfield(const polymod<numberfield> &value) {
-	this->is_valid = 1;
-	this->is_poly_value = 1;
-	this->poly_value = std::unique_ptr<polymod<numberfield>>(new polymod<numberfield>(value));
+	this->field = numberfield_descriptor::get(value.get_base());
+	this->poly_value = value.get_value();
 }
 
-numberfield::numberfield(const numberfield &other) {
-	this->is_valid = other.is_valid;
-	this->is_poly_value = other.is_poly_value;
-	if (this->is_poly_value) {
-		this->poly_value = std::unique_ptr<polymod<numberfield>>(new polymod<numberfield>(*(other.poly_value)));
+numberfield::numberfield(const numberfield &reference, poly<numberfield> value) {
+	this->field = reference.field;
+	if (!this->field) {
+		this->rational_value = value[0].get_rational_value();
+		return;
 	}
-	else {
-		this->rational_value = std::unique_ptr<mpq_class>(new mpq_class(*(other.rational_value)));
+
+	if (value.degree() >= this->field->modulus.degree())
+		this->poly_value = value.divide(this->field->modulus).remainder;
+	else
+		this->poly_value = std::move(value);
+}
+
+numberfield::numberfield(const numberfield &other) {
+	this->field = other.field;
+	if (this->field)
+		this->poly_value = other.poly_value;
+	else
+		this->rational_value = other.rational_value;
+}
+
+numberfield::numberfield(numberfield &&other) noexcept {
+	this->field = std::move(other.field);
+	this->rational_value = std::move(other.rational_value);
+	this->poly_value = std::move(other.poly_value);
+}
+
+void numberfield::promote(const std::shared_ptr<const numberfield_descriptor> &field) {
+	// Turns an element of a subfield into a constant of the given field
+	this->poly_value = poly<numberfield>(numberfield(*this));
+	this->field = field;
+	this->rational_value = 0;
+}
+
+bool is_subfield(std::shared_ptr<const numberfield_descriptor> sub, std::shared_ptr<const numberfield_descriptor> field) {
+	// Whether sub is a proper subfield of field in its tower
+	if (!field)
+		return false;
+	if (!sub)
+		return true;
+	while (field->base) {
+		field = field->base;
+		if (field == sub)
+			return true;
 	}
+	return false;
+}
+
+int numberfield::compare_fields(const numberfield &other) const {
+	// Returns 0 if both are in the same field, 1 if other lies in a subfield
+	// of this one, and -1 if this lies in a subfield of other
+	if (this->field == other.field)
+		return 0;
+	if (is_subfield(other.field, this->field))
+		return 1;
+	if (is_subfield(this->field, other.field))
+		return -1;
+	
+	numberfield_error();
+	return 0;
 }
 
 numberfield &numberfield::operator=(const mpq_class &value) {
-	this->is_valid = 1;
-	this->is_poly_value = 0;
-	this->rational_value = std::unique_ptr<mpq_class>(new mpq_class(value));
+	this->field.reset();
+	this->rational_value = value;
+	this->poly_value = poly<numberfield>();
 	return *this;
 }
 
 numberfield &numberfield::operator=(const polymod<numberfield> &value) {
-	this->is_valid = 1;
-	this->is_poly_value = 1;
-	this->poly_value = std::unique_ptr<polymod<numberfield>>(new polymod<numberfield>(value));
+	this->field = numberfield_descriptor::get(value.get_base());
+	this->poly_value = value.get_value();
 	return *this;
 }
 
 numberfield &numberfield::operator=(const numberfield &other) {
-	this->is_valid = other.is_valid;
-	this->is_poly_value = other.is_poly_value;
-	if (this->is_poly_value) {
-		this->poly_value = std::unique_ptr<polymod<numberfield>>(new polymod<numberfield>(*(other.poly_value)));
-	}
+	this->field = other.field;
+	if (this->field)
+		this->poly_value = other.poly_value;
 	else {
-		this->rational_value = std::unique_ptr<mpq_class>(new mpq_class(*(other.rational_value)));
+		this->rational_value = other.rational_value;
+		this->poly_value = poly<numberfield>();
 	}
 	return *this;
 }
 
+numberfield &numberfield::operator=(numberfield &&other) noexcept {
+	this->field = std::move(other.field);
+	this->rational_value = std::move(other.rational_value);
+	this->poly_value = std::move(other.poly_value);
+	return *this;
+}
+
 bool numberfield::is_poly() const {
-	return this->is_poly_value;
+	return (bool)this->field;
+}
+
+std::shared_ptr<const numberfield_descriptor> numberfield::get_field() const {
+	return this->field;
 }
 
 mpq_class numberfield::get_rational_value() const {
-	return (*(this->rational_value));
+	if (this->field)
+		numberfield_error();
+	return this->rational_value;
 }
 
 polymod<numberfield> numberfield::get_poly_value() const {
-	return (*(this->poly_value));
+	if (!this->field)
+		numberfield_error();
+	return polymod<numberfield>(this->field->modulus, this->poly_value);
 }
 
 bool numberfield::operator==(const numberfield &other) const {
-	if (!this->is_valid) {
+	int order = this->compare_fields(other);
+	if (order > 0)
+		return (this->poly_value.degree() < 1 && this->poly_value[0] == other);
+	if (order < 0)
 		return (other == *this);
-	}
-	if (!other.is_valid) {
-		if (this->is_poly_value)
-			return (*(this->poly_value) == util<polymod<numberfield>>::zero(*(this->poly_value)));
-		else
-			return (*(this->rational_value) == util<mpq_class>::zero(*(this->rational_value)));
-	}
-	if (this->is_poly_value && !other.is_poly_value) {
-		numberfield_error();
-		return false;
-	}
-	if (!this->is_poly_value && other.is_poly_value) {
-		numberfield_error();
-		return false;
-	}
-	if (this->is_poly_value) {
-		return (*(this->poly_value) == *(other.poly_value));
-	}
 	
-	return (*(this->rational_value) == *(other.rational_value));
+	if (this->field)
+		return (this->poly_value == other.poly_value);
+	return (this->rational_value == other.rational_value);
 }
 
 bool numberfield::operator!=(const numberfield &other) const {
@@ -101,85 +185,50 @@ bool numberfield::operator!=(const numberfield &other) const {
 }
 
 numberfield &numberfield::operator+=(const numberfield &other) {
-	if (!this->is_valid) {
-		*this = other;
-		return *this;
-	}
-	if (!other.is_valid) {
-		return *this;
-	}
-	if (this->is_poly_value && !other.is_poly_value) {
-		numberfield_error();
-		return *this;
-	}
-	if (!this->is_poly_value && other.is_poly_value) {
-		numberfield_error();
-		return *this;
-	}
-	if (this->is_poly_value) {
-		*(this->poly_value) += *(other.poly_value);
+	int order = this->compare_fields(other);
+	if (order > 0) {
+		this->poly_value += poly<numberfield>(other);
 		return *this;
 	}
+	if (order < 0)
+		this->promote(other.field);
 	
-	*(this->rational_value) += *(other.rational_value);
+	if (this->field)
+		this->poly_value += other.poly_value;
+	else
+		this->rational_value += other.rational_value;
 	return *this;
 }
 
 numberfield &numberfield::operator-=(const numberfield &other) {
-	if (!this->is_valid) {
-		*this = (-other);
-		return *this;
-	}
-	if (!other.is_valid) {
-		return *this;
-	}
-	if (this->is_poly_value && !other.is_poly_value) {
-		numberfield_error();
-		return *this;
-	}
-	if (!this->is_poly_value && other.is_poly_value) {
-		numberfield_error();
-		return *this;
-	}
-	if (this->is_poly_value) {
-		*(this->poly_value) -= *(other.poly_value);
+	int order = this->compare_fields(other);
+	if (order > 0) {
+		this->poly_value -= poly<numberfield>(other);
 		return *this;
 	}
+	if (order < 0)
+		this->promote(other.field);
 	
-	*(this->rational_value) -= *(other.rational_value);
+	if (this->field)
+		this->poly_value -= other.poly_value;
+	else
+		this->rational_value -= other.rational_value;
 	return *this;
 }
 
 numberfield &numberfield::operator*=(const numberfield &other) {
-	if (!this->is_valid) {
-		this->is_poly_value = other.is_poly_value;
-		if (this->is_poly_value)
-			*(this->poly_value) = util<polymod<numberfield>>::zero(*(other.poly_value));
-		else
-			*(this->rational_value) = util<mpq_class>::zero(*(other.rational_value));
-		return *this;
-	}
-	if (!other.is_valid) {
-		if (this->is_poly_value)
-			*(this->poly_value) = util<polymod<numberfield>>::zero(*(this->poly_value));
-		else
-			*(this->rational_value) = util<mpq_class>::zero(*(this->rational_value));
-		return *this;
-	}
-	if (this->is_poly_value && !other.is_poly_value) {
-		numberfield_error();
-		return *this;
-	}
-	if (!this->is_poly_value && other.is_poly_value) {
-		numberfield_error();
-		return *this;
-	}
-	if (this->is_poly_value) {
-		*(this->poly_value) *= *(other.poly_value);
+	int order = this->compare_fields(other);
+	if (order > 0) {
+		this->poly_value *= other;
 		return *this;
 	}
+	if (order < 0)
+		this->promote(other.field);
 	
-	*(this->rational_value) *= *(other.rational_value);
+	if (this->field)
+		this->poly_value = (this->poly_value * other.poly_value).divide(this->field->modulus).remainder;
+	else
+		this->rational_value *= other.rational_value;
 	return *this;
 }
 
@@ -204,36 +253,26 @@ numberfield numberfield::operator/(const numberfield &other) const {
 }
 
 numberfield numberfield::operator-() const {
-	if (!this->is_valid)
-		return numberfield(*this);
-	if (this->is_poly_value) {
-		return numberfield(-(*(this->poly_value)));
-	}
-	
-	return numberfield(-(*(this->rational_value)));
+	numberfield result(*this);
+	if (result.field)
+		result.poly_value = -result.poly_value;
+	else
+		result.rational_value = -result.rational_value;
+	return result;
 }
 
 numberfield numberfield::inv() const {
-	if (!this->is_valid) {
-		std::cout << "Error: divide by zero in numberfield" << std::endl;
-		int a = 1;
-		a /= (a - a);
-		return numberfield(*this);
-	}
-	if (this->is_poly_value) {
-		return numberfield((*(this->poly_value)).inv());
+	if (this->field) {
+		return numberfield(*this, this->get_poly_value().inv().get_value());
 	}
-	
-	return numberfield(1 / (*(this->rational_value)));
+
+	return numberfield(1 / this->rational_value);
 }
 
 std::ostream &operator<<(std::ostream &os, const numberfield &m) {
-	if (!m.is_valid) {
-		return os << "0";
-	}
-	if (m.is_poly_value)
-		return os << *m.poly_value;
-	return os << *m.rational_value;
+	if (m.field)
+		return os << m.poly_value;
+	return os << m.rational_value;
 }
 
 numberfield util<numberfield>::zero() {
@@ -241,23 +280,144 @@ numberfield util<numberfield>::zero() {
 }
 
 numberfield util<numberfield>::zero(const numberfield &reference) {
-	return numberfield() * reference;
+	if (reference.is_poly())
+		return numberfield(reference, poly<numberfield>());
+	return numberfield();
+}
+
+numberfield util<numberfield>::one() {
+	return numberfield(mpq_class(1));
 }
 
 numberfield util<numberfield>::one(const numberfield &reference) {
-	if (reference.is_poly()) {
-		return numberfield(util<polymod<numberfield>>::one(reference.get_poly_value()));
-	}
-	return numberfield(util<mpq_class>::one(reference.get_rational_value()));
+	if (reference.is_poly())
+		return numberfield(reference, poly<numberfield>(util<numberfield>::one()));
+	return util<numberfield>::one();
 }
 
 numberfield util<numberfield>::from_int(int n, const numberfield &reference) {
-	if (reference.is_poly()) {
-		return numberfield(util<polymod<numberfield>>::from_int(n, reference.get_poly_value()));
-	}
-	return numberfield(util<mpq_class>::from_int(n, reference.get_rational_value()));
+	if (reference.is_poly())
+		return numberfield(reference, poly<numberfield>(numberfield(mpq_class(n))));
+	return numberfield(mpq_class(n));
 }
 
 numberfield util<numberfield>::get_gcd(numberfield a, numberfield b) {
 	return a;
-}
\ No newline at end of file
+}
+
+absolute_field::absolute_field(const numberfield &reference) {
+	// Builds the primitive element one level at a time. If Q(alpha) is the
+	// flattening of K_(i-1) and K_i = K_(i-1)[y]/(u), Trager's norm gives a
+	// k for which theta = y + k alpha has squarefree, hence irreducible,
+	// minimal polynomial N = Res_t(T(t), u(x - kt, t)). Then alpha is the
+	// unique common root of T(t) and u(theta - kt, t) over Q(theta), and
+	// y = theta - k alpha.
+	
+	std::shared_ptr<const numberfield_descriptor> field = reference.get_field();
+	while (field) {
+		this->tower.insert(this->tower.begin(), field);
+		field = field->base;
+	}
+	
+	this->modulus = poly<mpq_class>({0, 1});
+	this->theta = numberfield();
+	
+	for (int level = 0; level < this->tower.size(); level++) {
+		poly<numberfield> m = this->tower[level]->modulus;
+		std::vector<polymod<mpq_class>> us;
+		for (int i = 0; i <= m.degree(); i++)
+			us.push_back(this->flatten(m[i]));
+		poly<polymod<mpq_class>> u(us);
+		
+		mpq_class k = 0;
+		poly<mpq_class> norm;
+		while (true) {
+			int hint = norm_squarefree_hint(u, k);
+			if (hint != 0) {
+				norm = trager_norm(u, k);
+				if (hint == 1 || sub_resultant_gcd(norm, norm.derivative()).degree() == 0)
+					break;
+			}
+			k++;
+		}
+		norm /= norm.leading();
+		
+		polymod<mpq_class> theta_flat(norm, poly<mpq_class>({0, 1}));
+		polymod<mpq_class> k_flat(norm, poly<mpq_class>(k));
+		poly<polymod<mpq_class>> x_minus_kt({theta_flat, -k_flat});
+		std::vector<polymod<mpq_class>> t_coeffs;
+		for (int i = 0; i <= this->modulus.degree(); i++)
+			t_coeffs.push_back(polymod<mpq_class>(norm, poly<mpq_class>(this->modulus[i])));
+		poly<polymod<mpq_class>> t_emb(t_coeffs);
+		poly<polymod<mpq_class>> v;
+		for (int i = u.degree(); i >= 0; i--) {
+			poly<mpq_class> ui = u[i].get_value();
+			std::vector<polymod<mpq_class>> ui_coeffs;
+			for (int j = 0; j <= ui.degree(); j++)
+				ui_coeffs.push_back(polymod<mpq_class>(norm, poly<mpq_class>(ui[j])));
+			v = v*x_minus_kt + poly<polymod<mpq_class>>(ui_coeffs);
+		}
+		poly<polymod<mpq_class>> g = std::get<2>(extended_gcd(t_emb, v));
+		polymod<mpq_class> alpha = -g[0] / g[1];
+		
+		for (int i = 0; i < this->generators.size(); i++) {
+			poly<mpq_class> gen = this->generators[i].get_value();
+			polymod<mpq_class> image(norm, poly<mpq_class>());
+			for (int j = gen.degree(); j >= 0; j--)
+				image = image*alpha + polymod<mpq_class>(norm, poly<mpq_class>(gen[j]));
+			this->generators[i] = image;
+		}
+		this->generators.push_back(theta_flat - k_flat*alpha);
+		this->modulus = norm;
+		
+		numberfield y(polymod<numberfield>(m, poly<numberfield>({numberfield(0), numberfield(1)})));
+		this->theta = y + numberfield(k)*this->theta;
+	}
+}
+
+poly<mpq_class> absolute_field::get_modulus() const {
+	return this->modulus;
+}
+
+numberfield absolute_field::get_primitive_element() const {
+	return this->theta;
+}
+
+polymod<mpq_class> absolute_field::flatten(const numberfield &a) const {
+	if (!a.is_poly())
+		return polymod<mpq_class>(this->modulus, poly<mpq_class>(a.get_rational_value()));
+	
+	int level = a.get_field()->depth - 1;
+	if (level >= this->generators.size() || this->tower[level] != a.get_field()) {
+		numberfield_error();
+		return polymod<mpq_class>(this->modulus, poly<mpq_class>());
+	}
+	
+	poly<numberfield> value = a.get_poly_value().get_value();
+	polymod<mpq_class> result(this->modulus, poly<mpq_class>());
+	for (int i = value.degree(); i >= 0; i--)
+		result = result*this->generators[level] + this->flatten(value[i]);
+	return result;
+}
+
+poly<polymod<mpq_class>> absolute_field::flatten(const poly<numberfield> &a) const {
+	std::vector<polymod<mpq_class>> coeffs;
+	for (int i = 0; i <= a.degree(); i++)
+		coeffs.push_back(this->flatten(a[i]));
+	return poly<polymod<mpq_class>>(coeffs);
+}
+
+numberfield absolute_field::unflatten(const polymod<mpq_class> &a) const {
+	poly<mpq_class> value = a.get_value();
+	numberfield result;
+	for (int i = value.degree(); i >= 0; i--)
+		result = result*this->theta + numberfield(value[i]);
+	return result;
+}
+
+poly<numberfield> absolute_field::unflatten(const poly<polymod<mpq_class>> &a) const {
+	std::vector<numberfield> coeffs;
+	for (int i = 0; i <= a.degree(); i++)
+		coeffs.push_back(this->unflatten(a[i]));
+	return poly<numberfield>(coeffs);
+}
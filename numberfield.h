@@ -14,26 +14,40 @@
 
 #pragma once
 
+class numberfield_descriptor;
+
 class numberfield {
+	// Either a rational number, or an element of K[x]/(modulus) for some
+	// number field K, which is itself either Q or another numberfield.
+	// Elements of the same field share one descriptor holding the modulus,
+	// and elements of a subfield (including rationals) are coerced into
+	// whatever extension they meet.
+	
 	private:
-		std::unique_ptr<mpq_class> rational_value;
-		std::unique_ptr<polymod<numberfield>> poly_value;
-		bool is_valid;
-		bool is_poly_value;
+		std::shared_ptr<const numberfield_descriptor> field;
+		mpq_class rational_value;
+		poly<numberfield> poly_value;
+		
+		void promote(const std::shared_ptr<const numberfield_descriptor> &field);
+		int compare_fields(const numberfield &other) const;
 		
 	public:
 		numberfield();
 		numberfield(const mpq_class &value);
 		numberfield(const polymod<numberfield> &value);
+		numberfield(const numberfield &reference, poly<numberfield> value);
 		numberfield(const numberfield &other);
+		numberfield(numberfield &&other) noexcept;
 		
 		bool is_poly() const;
+		std::shared_ptr<const numberfield_descriptor> get_field() const;
 		mpq_class get_rational_value() const;
 		polymod<numberfield> get_poly_value() const;
 
 		numberfield &operator=(const mpq_class &value);
 		numberfield &operator=(const polymod<numberfield> &value);
 		numberfield &operator=(const numberfield &other);
+		numberfield &operator=(numberfield &&other) noexcept;
 		
 		bool operator==(const numberfield &other) const;
 		bool operator!=(const numberfield &other) const;
@@ -54,6 +68,42 @@ class numberfield {
 		friend std::ostream &operator<<(std::ostream &os, const numberfield &p);
 };
 
+class numberfield_descriptor {
+	// The field base[x]/(modulus), where base is the largest field any
+	// coefficient of the modulus lies in (null for Q), and depth is the
+	// number of extensions above Q
+	
+	public:
+		poly<numberfield> modulus;
+		std::shared_ptr<const numberfield_descriptor> base;
+		int depth;
+		
+		static std::shared_ptr<const numberfield_descriptor> get(const poly<numberfield> &modulus);
+};
+
+class absolute_field {
+	// A tower Q < K_1 < ... < K_n of numberfields, flattened into
+	// Q(theta) = Q[x]/(modulus) for a primitive element theta, so that
+	// arithmetic and factoring can be done at a single level
+	
+	private:
+		std::vector<std::shared_ptr<const numberfield_descriptor>> tower;
+		poly<mpq_class> modulus;
+		std::vector<polymod<mpq_class>> generators;
+		numberfield theta;
+		
+	public:
+		absolute_field(const numberfield &reference);
+		
+		poly<mpq_class> get_modulus() const;
+		numberfield get_primitive_element() const;
+		
+		polymod<mpq_class> flatten(const numberfield &a) const;
+		poly<polymod<mpq_class>> flatten(const poly<numberfield> &a) const;
+		numberfield unflatten(const polymod<mpq_class> &a) const;
+		poly<numberfield> unflatten(const poly<polymod<mpq_class>> &a) const;
+};
+
 template <>
 class util<numberfield> {
 public:
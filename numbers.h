@@ -57,6 +57,14 @@ T util<T>::get_sqrt(T a) {
 	return sqrt(a);
 }
 
+template <typename T>
+void multiply_add(T &acc, const T &x, const T &c) {
+	// acc = acc*x + c, the step of Horner's rule; types with a fused
+	// version overload this
+	acc *= x;
+	acc += c;
+}
+
 template <typename T>
 T util<T>::get_pow(T a, int exp) {
 	T result = util<T>::one(a);
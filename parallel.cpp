@@ -0,0 +1,38 @@
+#include <atomic>
+#include <vector>
+
+#include "parallel.h"
+
+unsigned int thread_count() {
+	unsigned int threads = std::thread::hardware_concurrency();
+	return threads > 0 ? threads : 1;
+}
+
+void parallel_for(int n, std::function<void(int)> body, unsigned int threads) {
+	// Runs body(0), ..., body(n - 1), spread over the given number of
+	// threads (by default one per core). The calls must be independent;
+	// each thread takes the next unclaimed index until none are left.
+	
+	if (threads == 0)
+		threads = thread_count();
+	if (threads > n)
+		threads = n;
+	if (threads <= 1) {
+		for (int i = 0; i < n; i++)
+			body(i);
+		return;
+	}
+	
+	std::atomic<int> next(0);
+	std::function<void()> worker = [&]() {
+		for (int i = next++; i < n; i = next++)
+			body(i);
+	};
+	
+	std::vector<std::thread> pool;
+	for (unsigned int i = 1; i < threads; i++)
+		pool.push_back(std::thread(worker));
+	worker();
+	for (int i = 0; i < pool.size(); i++)
+		pool[i].join();
+}
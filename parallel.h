@@ -0,0 +1,7 @@
+#include <functional>
+#include <thread>
+
+#pragma once
+
+unsigned int thread_count();
+void parallel_for(int n, std::function<void(int)> body, unsigned int threads = 0);
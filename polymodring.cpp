@@ -0,0 +1,443 @@
+#include <mutex>
+
+#include "polymodring.h"
+#include "alg.h"
+
+std::shared_ptr<const rational_modulus> rational_modulus::get(const poly<mpq_class> &base) {
+	// Moduli are interned, so that every element of a field shares one copy
+
+	if (base.degree() < 0)
+		return std::shared_ptr<const rational_modulus>();
+
+	static std::mutex registry_mutex;
+	static std::vector<std::weak_ptr<const rational_modulus>> registry;
+
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	for (int i = registry.size() - 1; i >= 0; i--) {
+		std::shared_ptr<const rational_modulus> modulus = registry[i].lock();
+		if (!modulus) {
+			registry.erase(registry.begin() + i);
+			continue;
+		}
+		if (modulus->base == base)
+			return modulus;
+	}
+
+	std::shared_ptr<rational_modulus> modulus(new rational_modulus());
+	modulus->base = base;
+	mpz_class common_denominator = 1;
+	for (int i = 0; i <= base.degree(); i++)
+		common_denominator = lcm(common_denominator, base[i].get_den());
+	std::vector<mpz_class> coeffs;
+	for (int i = 0; i <= base.degree(); i++)
+		coeffs.push_back(base[i].get_num() * (common_denominator / base[i].get_den()));
+	modulus->integral = poly<mpz_class>(coeffs);
+	modulus->integral /= modulus->integral.content();
+	if (modulus->integral.leading() < 0)
+		modulus->integral = -modulus->integral;
+
+	modulus->kind = rational_modulus::general_field;
+	modulus->order = 0;
+	int degree = modulus->integral.degree();
+	if (degree == 2)
+		modulus->kind = rational_modulus::quadratic_field;
+	else if (degree > 2 && modulus->integral.leading() == 1 && modulus->integral[0] == 1) {
+		// phi(n) >= sqrt(n/2), so only n <= 2 degree^2 can give Phi_n
+		for (int n = 3; n <= 2*degree*degree; n++) {
+			if (euler_phi(n) != degree || cyclotomic(n) != modulus->integral)
+				continue;
+			modulus->kind = rational_modulus::cyclotomic_field;
+			modulus->order = n;
+			break;
+		}
+	}
+
+	if (degree > 2 && degree <= adjugate_inverse_threshold) {
+		// Multiplying by x and cancelling the top term with the modulus
+		// gains at most one power of lc per step
+		mpz_class lc = modulus->integral.leading();
+		modulus->power_scale = 1;
+		for (int i = 1; i < degree; i++)
+			modulus->power_scale *= lc;
+		std::vector<mpz_class> v(degree, 0);
+		v[degree - 1] = modulus->power_scale;
+		for (int k = degree; k <= 2*degree - 2; k++) {
+			mpz_class top = v[degree - 1] / lc;
+			for (int i = degree - 1; i > 0; i--)
+				v[i] = v[i - 1] - top * modulus->integral[i];
+			v[0] = -top * modulus->integral[0];
+			modulus->powers.push_back(v);
+		}
+	}
+
+	registry.push_back(modulus);
+	return modulus;
+}
+
+void polymod<mpq_class>::set_value(const poly<mpq_class> &value) {
+	this->denominator = 1;
+	for (int i = 0; i <= value.degree(); i++)
+		this->denominator = lcm(this->denominator, value[i].get_den());
+	std::vector<mpz_class> coeffs;
+	for (int i = 0; i <= value.degree(); i++)
+		coeffs.push_back(value[i].get_num() * (this->denominator / value[i].get_den()));
+	this->numerator = poly<mpz_class>(coeffs);
+}
+
+void polymod<mpq_class>::reduce() {
+	// Pseudo-division by the integral modulus m. Each step scales by just
+	// enough of lc(m) to cancel the leading term, and the denominator
+	// absorbs the scaling.
+
+	if (!this->modulus)
+		return;
+
+	int dm = this->modulus->integral.degree();
+	int dn = this->numerator.degree();
+	if (dn < dm)
+		return;
+
+	std::vector<mpz_class> m, a;
+	for (int i = 0; i <= dm; i++)
+		m.push_back(this->modulus->integral[i]);
+	for (int i = 0; i <= dn; i++)
+		a.push_back(this->numerator[i]);
+
+	for (int i = dn; i >= dm; i--) {
+		if (a[i] == 0)
+			continue;
+		mpz_class q = a[i];
+		if (m[dm] != 1) {
+			mpz_class g = gcd(q, m[dm]);
+			mpz_class scale = m[dm] / g;
+			q /= g;
+			if (scale != 1) {
+				for (int j = 0; j < i; j++)
+					a[j] *= scale;
+				this->denominator *= scale;
+			}
+		}
+		for (int j = 0; j < dm; j++)
+			if (m[j] != 0)
+				a[i - dm + j] -= q * m[j];
+		a[i] = 0;
+	}
+
+	a.resize(dm);
+	this->numerator = poly<mpz_class>(a);
+}
+
+void polymod<mpq_class>::normalize() {
+	if (this->numerator.degree() < 0) {
+		this->denominator = 1;
+		return;
+	}
+
+	mpz_class g = gcd(this->numerator.content(), this->denominator);
+	if (g != 1) {
+		this->numerator /= g;
+		this->denominator /= g;
+	}
+}
+
+void polymod<mpq_class>::multiply_quadratic(const polymod<mpq_class> &other) {
+	// (u0 + u1 x)(v0 + v1 x) in closed form, using m2 x^2 = -(m1 x + m0)
+	// and moving the m2 into the denominator
+
+	const poly<mpz_class> &m = this->modulus->integral;
+	mpz_class u0 = this->numerator[0], u1 = this->numerator[1];
+	mpz_class v0 = other.numerator[0], v1 = other.numerator[1];
+	mpz_class top = u1 * v1;
+	// other may be *this, so read its denominator before anything changes
+	if (top == 0) {
+		this->denominator = this->denominator * other.denominator;
+		this->numerator = poly<mpz_class>({u0 * v0, u0 * v1 + u1 * v0});
+	}
+	else {
+		this->denominator = this->denominator * other.denominator * m[2];
+		this->numerator = poly<mpz_class>({m[2] * u0 * v0 - m[0] * top, m[2] * (u0 * v1 + u1 * v0) - m[1] * top});
+	}
+}
+
+void polymod<mpq_class>::fold_cyclotomic() {
+	// Phi_n divides x^n - 1, so x^i can become x^(i mod n) before the
+	// division by Phi_n, which then has at most n - phi(n) terms to cancel
+
+	int n = this->modulus->order;
+	int dn = this->numerator.degree();
+	if (dn < n)
+		return;
+
+	std::vector<mpz_class> a(n, 0);
+	for (int i = 0; i <= dn; i++)
+		a[i % n] += this->numerator[i];
+	this->numerator = poly<mpz_class>(a);
+}
+
+polymod<mpq_class> polymod<mpq_class>::inv_quadratic() const {
+	// 1/(n0 + n1 x) = (m2 n0 - m1 n1 - m2 n1 x) / N, where
+	// N = m2 n0^2 - m1 n0 n1 + m0 n1^2 is m2 times the norm
+
+	const poly<mpz_class> &m = this->modulus->integral;
+	mpz_class n0 = this->numerator[0], n1 = this->numerator[1];
+	mpz_class norm = m[2] * n0 * n0 - m[1] * n0 * n1 + m[0] * n1 * n1;
+
+	polymod<mpq_class> result(*this);
+	result.numerator = poly<mpz_class>({this->denominator * (m[2] * n0 - m[1] * n1), -this->denominator * m[2] * n1});
+	result.denominator = norm;
+	if (norm < 0) {
+		result.numerator = -result.numerator;
+		result.denominator = -norm;
+	}
+	result.normalize();
+	return result;
+}
+
+polymod<mpq_class> polymod<mpq_class>::inv_adjugate() const {
+	// Solves M y = e_0 for the matrix M of multiplication by the numerator,
+	// whose columns come from the cached powers of x, by fraction-free
+	// (Bareiss) elimination. Then y = adj(M) e_0 / det(M), and everything
+	// stays integral until the final division.
+
+	int d = this->modulus->integral.degree();
+	const std::vector<std::vector<mpz_class>> &powers = this->modulus->powers;
+	std::vector<mpz_class> n;
+	for (int i = 0; i <= this->numerator.degree(); i++)
+		n.push_back(this->numerator[i]);
+
+	std::vector<std::vector<mpz_class>> a(d, std::vector<mpz_class>(d + 1, 0));
+	for (int j = 0; j < d; j++) {
+		for (int i = 0; i < n.size(); i++) {
+			if (n[i] == 0)
+				continue;
+			if (i + j < d)
+				a[i + j][j] += n[i] * this->modulus->power_scale;
+			else
+				for (int r = 0; r < d; r++)
+					a[r][j] += n[i] * powers[i + j - d][r];
+		}
+	}
+	a[0][d] = 1;
+
+	mpz_class previous = 1;
+	for (int k = 0; k < d; k++) {
+		int pivot = k;
+		while (pivot < d && a[pivot][k] == 0)
+			pivot++;
+		if (pivot == d)
+			return polymod<mpq_class>(*this, poly<mpq_class>());
+		std::swap(a[pivot], a[k]);
+		for (int i = k + 1; i < d; i++) {
+			for (int j = k + 1; j <= d; j++) {
+				a[i][j] = a[k][k] * a[i][j] - a[i][k] * a[k][j];
+				mpz_divexact(a[i][j].get_mpz_t(), a[i][j].get_mpz_t(), previous.get_mpz_t());
+			}
+			a[i][k] = 0;
+		}
+		previous = a[k][k];
+	}
+
+	mpz_class det = a[d - 1][d - 1];
+	std::vector<mpz_class> y(d);
+	for (int i = d - 1; i >= 0; i--) {
+		mpz_class sum = det * a[i][d];
+		for (int j = i + 1; j < d; j++)
+			sum -= a[i][j] * y[j];
+		mpz_divexact(y[i].get_mpz_t(), sum.get_mpz_t(), a[i][i].get_mpz_t());
+	}
+
+	// M is power_scale * denominator times the multiplication matrix of
+	// this element
+	mpz_class scale = this->modulus->power_scale * this->denominator;
+	if (det < 0) {
+		det = -det;
+		scale = -scale;
+	}
+	for (int i = 0; i < d; i++)
+		y[i] *= scale;
+
+	polymod<mpq_class> result(*this);
+	result.numerator = poly<mpz_class>(y);
+	result.denominator = det;
+	result.normalize();
+	return result;
+}
+
+polymod<mpq_class>::polymod() {
+	this->denominator = 1;
+}
+
+polymod<mpq_class>::polymod(poly<mpq_class> value) {
+	this->set_value(value);
+}
+
+polymod<mpq_class>::polymod(poly<mpq_class> base, poly<mpq_class> value) {
+	this->modulus = rational_modulus::get(base);
+	this->set_value(value);
+	this->reduce();
+	this->normalize();
+}
+
+polymod<mpq_class>::polymod(const polymod<mpq_class> &other) {
+	this->modulus = other.modulus;
+	this->numerator = other.numerator;
+	this->denominator = other.denominator;
+}
+
+polymod<mpq_class>::polymod(polymod<mpq_class> &&other) noexcept {
+	this->modulus = std::move(other.modulus);
+	this->numerator = std::move(other.numerator);
+	this->denominator = std::move(other.denominator);
+}
+
+polymod<mpq_class>::polymod(const polymod<mpq_class> &other, poly<mpq_class> value) {
+	this->modulus = other.modulus;
+	this->set_value(value);
+	this->reduce();
+	this->normalize();
+}
+
+poly<mpq_class> polymod<mpq_class>::get_base() const {
+	if (!this->modulus)
+		return poly<mpq_class>();
+	return this->modulus->base;
+}
+
+poly<mpq_class> polymod<mpq_class>::get_value() const {
+	std::vector<mpq_class> coeffs;
+	for (int i = 0; i <= this->numerator.degree(); i++)
+		coeffs.push_back(mpq_class(this->numerator[i], this->denominator));
+	for (int i = 0; i < coeffs.size(); i++)
+		coeffs[i].canonicalize();
+	return poly<mpq_class>(coeffs);
+}
+
+polymod<mpq_class> &polymod<mpq_class>::operator=(poly<mpq_class> value) {
+	this->set_value(value);
+	this->reduce();
+	this->normalize();
+	return *this;
+}
+
+polymod<mpq_class> &polymod<mpq_class>::operator=(const polymod<mpq_class> &other) {
+	this->modulus = other.modulus;
+	this->numerator = other.numerator;
+	this->denominator = other.denominator;
+	return *this;
+}
+
+polymod<mpq_class> &polymod<mpq_class>::operator=(polymod<mpq_class> &&other) noexcept {
+	this->modulus = std::move(other.modulus);
+	this->numerator = std::move(other.numerator);
+	this->denominator = std::move(other.denominator);
+	return *this;
+}
+
+bool polymod<mpq_class>::operator==(const polymod<mpq_class> &other) const {
+	if (this->denominator == other.denominator)
+		return (this->numerator == other.numerator);
+	return (this->numerator * other.denominator == other.numerator * this->denominator);
+}
+
+bool polymod<mpq_class>::operator!=(const polymod<mpq_class> &other) const {
+	return !(*this == other);
+}
+
+polymod<mpq_class> &polymod<mpq_class>::operator+=(const polymod<mpq_class> &other) {
+	if (!this->modulus)
+		this->modulus = other.modulus;
+
+	if (this->denominator == other.denominator)
+		this->numerator += other.numerator;
+	else {
+		mpz_class g = gcd(this->denominator, other.denominator);
+		this->numerator *= other.denominator / g;
+		this->numerator += other.numerator * (this->denominator / g);
+		this->denominator *= other.denominator / g;
+	}
+	this->reduce();
+	return *this;
+}
+
+polymod<mpq_class> &polymod<mpq_class>::operator-=(const polymod<mpq_class> &other) {
+	if (!this->modulus)
+		this->modulus = other.modulus;
+
+	if (this->denominator == other.denominator)
+		this->numerator -= other.numerator;
+	else {
+		mpz_class g = gcd(this->denominator, other.denominator);
+		this->numerator *= other.denominator / g;
+		this->numerator -= other.numerator * (this->denominator / g);
+		this->denominator *= other.denominator / g;
+	}
+	this->reduce();
+	return *this;
+}
+
+polymod<mpq_class> &polymod<mpq_class>::operator*=(const polymod<mpq_class> &other) {
+	if (!this->modulus)
+		this->modulus = other.modulus;
+
+	if (this->modulus && this->modulus->kind == rational_modulus::quadratic_field)
+		this->multiply_quadratic(other);
+	else {
+		this->numerator *= other.numerator;
+		this->denominator *= other.denominator;
+		if (this->modulus && this->modulus->kind == rational_modulus::cyclotomic_field)
+			this->fold_cyclotomic();
+		this->reduce();
+	}
+	this->normalize();
+	return *this;
+}
+
+polymod<mpq_class> &polymod<mpq_class>::operator/=(const polymod<mpq_class> &other) {
+	return (*this) *= other.inv();
+}
+
+polymod<mpq_class> polymod<mpq_class>::operator+(const polymod<mpq_class> &other) const {
+	return polymod<mpq_class>(*this) += other;
+}
+
+polymod<mpq_class> polymod<mpq_class>::operator-(const polymod<mpq_class> &other) const {
+	return polymod<mpq_class>(*this) -= other;
+}
+
+polymod<mpq_class> polymod<mpq_class>::operator*(const polymod<mpq_class> &other) const {
+	return polymod<mpq_class>(*this) *= other;
+}
+
+polymod<mpq_class> polymod<mpq_class>::operator/(const polymod<mpq_class> &other) const {
+	return polymod<mpq_class>(*this) /= other;
+}
+
+polymod<mpq_class> polymod<mpq_class>::operator-() const {
+	polymod<mpq_class> result(*this);
+	result.numerator = -result.numerator;
+	return result;
+}
+
+polymod<mpq_class> polymod<mpq_class>::inv() const {
+	if (this->numerator.degree() == 0) {
+		polymod<mpq_class> result(*this);
+		result.numerator = poly<mpz_class>(this->denominator);
+		result.denominator = this->numerator[0];
+		if (result.denominator < 0) {
+			result.numerator = -result.numerator;
+			result.denominator = -result.denominator;
+		}
+		return result;
+	}
+	if (this->modulus && this->modulus->kind == rational_modulus::quadratic_field)
+		return this->inv_quadratic();
+	if (this->modulus && !this->modulus->powers.empty())
+		return this->inv_adjugate();
+
+	std::tuple<poly<mpq_class>, poly<mpq_class>, poly<mpq_class>> gcd = extended_gcd(this->get_value(), this->get_base());
+	return polymod<mpq_class>(*this, std::get<0>(gcd)/std::get<2>(gcd));
+}
+
+polymod<mpq_class>::operator poly<mpq_class>() {
+	return this->get_value();
+}
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <functional>
 #include <initializer_list>
 #include <iostream>
+#include <memory>
 
 #include "numbers.h"
 #include "polyring.h"
@@ -47,6 +48,89 @@ class polymod {
 		operator poly<T>();
 };
 
+// Up to this degree, polymod<Q> keeps a table of powers of x reduced by
+// the modulus and inverts through the multiplication matrix rather than
+// the extended gcd.
+const int adjugate_inverse_threshold = 32;
+
+class rational_modulus {
+	// A modulus in Q[x] together with its primitive integral multiple,
+	// shared by every element of Q[x]/(base). Quadratic and cyclotomic
+	// moduli are recognized once here, so that element arithmetic can use
+	// closed forms for them.
+	
+	public:
+		enum field_kind { general_field, quadratic_field, cyclotomic_field };
+		
+		poly<mpq_class> base;
+		poly<mpz_class> integral;
+		field_kind kind;
+		int order; // n if integral is Phi_n
+		
+		// x^k mod integral for degree <= k <= 2 degree - 2, each scaled by
+		// power_scale = lc^(degree - 1) to make it integral
+		std::vector<std::vector<mpz_class>> powers;
+		mpz_class power_scale;
+		
+		static std::shared_ptr<const rational_modulus> get(const poly<mpq_class> &base);
+};
+
+template <>
+class polymod<mpq_class> {
+	// Elements of Q[x]/(base) are stored as an integer polynomial over a
+	// single positive denominator, so that arithmetic works with integers
+	// rather than canonicalizing a rational for every coefficient.
+	// Reduction uses pseudo-division by the integral modulus, and common
+	// factors of the numerator and denominator are only removed after
+	// multiplication.
+	
+	private:
+		std::shared_ptr<const rational_modulus> modulus;
+		poly<mpz_class> numerator;
+		mpz_class denominator;
+		
+		void set_value(const poly<mpq_class> &value);
+		void reduce();
+		void normalize();
+		void multiply_quadratic(const polymod<mpq_class> &other);
+		void fold_cyclotomic();
+		polymod<mpq_class> inv_quadratic() const;
+		polymod<mpq_class> inv_adjugate() const;
+		
+	public:
+		polymod();
+		explicit polymod(poly<mpq_class> value);
+		polymod(poly<mpq_class> base, poly<mpq_class> value);
+		polymod(const polymod<mpq_class> &other);
+		polymod(polymod<mpq_class> &&other) noexcept;
+		polymod(const polymod<mpq_class> &other, poly<mpq_class> value);
+		
+		poly<mpq_class> get_base() const;
+		poly<mpq_class> get_value() const;
+		
+		polymod<mpq_class> &operator=(poly<mpq_class> value);
+		polymod<mpq_class> &operator=(const polymod<mpq_class> &other);
+		polymod<mpq_class> &operator=(polymod<mpq_class> &&other) noexcept;
+		
+		bool operator==(const polymod<mpq_class> &other) const;
+		bool operator!=(const polymod<mpq_class> &other) const;
+		
+		polymod<mpq_class> &operator+=(const polymod<mpq_class> &other);
+		polymod<mpq_class> &operator-=(const polymod<mpq_class> &other);
+		polymod<mpq_class> &operator*=(const polymod<mpq_class> &other);
+		polymod<mpq_class> &operator/=(const polymod<mpq_class> &other);
+		
+		polymod<mpq_class> operator+(const polymod<mpq_class> &other) const;
+		polymod<mpq_class> operator-(const polymod<mpq_class> &other) const;
+		polymod<mpq_class> operator*(const polymod<mpq_class> &other) const;
+		polymod<mpq_class> operator/(const polymod<mpq_class> &other) const;
+		
+		polymod<mpq_class> operator-() const;
+		polymod<mpq_class> inv() const;
+		
+		operator poly<mpq_class>();
+};
+
 template <typename T>
 std::function<polymod<T>(poly<T>)> to_mod(poly<T> base);
 
@@ -67,17 +151,17 @@ polymod<T> util<polymod<T>>::zero() {
 
 template <typename T>
 polymod<T> util<polymod<T>>::zero(const polymod<T> &reference) {
-	return polymod<T>(reference.get_base(), util<poly<T>>::zero());
+	return polymod<T>(reference, util<poly<T>>::zero());
 }
 
 template <typename T>
 polymod<T> util<polymod<T>>::one(const polymod<T> &reference) {
-	return polymod<T>(reference.get_base(), util<poly<T>>::one(reference.get_value()));
+	return polymod<T>(reference, util<poly<T>>::one(reference.get_value()));
 }
 
 template <typename T>
 polymod<T> util<polymod<T>>::from_int(int n, const polymod<T> &reference) {
-	return polymod<T>(reference.get_base(), util<poly<T>>::from_int(n, reference.get_value()));
+	return polymod<T>(reference, util<poly<T>>::from_int(n, reference.get_value()));
 }
 
 template <typename T>
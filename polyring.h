@@ -4,6 +4,7 @@
 #include <initializer_list>
 #include <iostream>
 #include <functional>
+#include <algorithm>
 
 #include "numbers.h"
 
@@ -33,6 +34,7 @@ class poly {
 		poly(std::vector<T> coeffs);
 		poly(std::initializer_list<T> coeffs);
 		poly(const poly<T> &other);
+		poly(poly<T> &&other) noexcept;
 		
 		void simplify();
 		
@@ -44,6 +46,7 @@ class poly {
 		poly<T> &operator=(std::vector<T> coeffs);
 		poly<T> &operator=(std::initializer_list<T> coeffs);
 		poly<T> &operator=(const poly<T> &other);
+		poly<T> &operator=(poly<T> &&other) noexcept;
 		
 		bool operator==(const poly<T> &other) const;
 		bool operator!=(const poly<T> &other) const;
@@ -97,7 +100,10 @@ class poly {
 		T leading();
 		
 		poly<T> compose(poly<T> x);
-		T evaluate(T x);
+		poly<T> taylor_shift(T k) const;
+		T evaluate(T x) const;
+		std::pair<T, T> evaluate_with_derivative(T x) const;
+		std::vector<T> evaluate_derivatives(T x, int k) const;
 };
 
 template <typename T>
@@ -159,7 +165,7 @@ poly<T>::poly(T constant) {
 
 template <typename T>
 poly<T>::poly(std::vector<T> coeffs) {
-	this->coeffs = coeffs;
+	this->coeffs = std::move(coeffs);
 	this->simplify();
 }
 
@@ -174,6 +180,11 @@ poly<T>::poly(const poly<T> &other) {
 	this->coeffs = other.coeffs;
 }
 
+template <typename T>
+poly<T>::poly(poly<T> &&other) noexcept {
+	this->coeffs = std::move(other.coeffs);
+}
+
 template <typename T>
 void poly<T>::simplify() {
 	while (this->coeffs.size() > 0 && this->coeffs[this->coeffs.size() - 1] == util<T>::zero(this->coeffs[this->coeffs.size() - 1]))
@@ -206,12 +217,14 @@ poly<T> &poly<T>::operator=(T constant) {
 	this->coeffs = std::vector<T>();
 	this->coeffs.push_back(constant);
 	this->simplify();
+	return *this;
 }
 
 template <typename T>
 poly<T> &poly<T>::operator=(std::vector<T> coeffs) {
-	this->coeffs = coeffs;
+	this->coeffs = std::move(coeffs);
 	this->simplify();
+	return *this;
 }
 
 template <typename T>
@@ -219,11 +232,19 @@ poly<T> &poly<T>::operator=(std::initializer_list<T> coeffs) {
 	this->coeffs = std::vector<T>();
 	this->coeffs.insert(this->coeffs.end(), coeffs.begin(), coeffs.end());
 	this->simplify();
+	return *this;
 }
 
 template <typename T>
 poly<T> &poly<T>::operator=(const poly<T> &other) {
 	this->coeffs = other.coeffs;
+	return *this;
+}
+
+template <typename T>
+poly<T> &poly<T>::operator=(poly<T> &&other) noexcept {
+	this->coeffs = std::move(other.coeffs);
+	return *this;
 }
 
 template <typename T>
@@ -343,43 +364,111 @@ poly<T> poly<T>::operator-(const poly<T> &p) const {
 	return poly<T>(*this) -= p;
 }
 
+// Below this many coefficients in either factor, schoolbook multiplication
+// beats Karatsuba; the extra additions aren't worth it for small inputs.
+const unsigned int karatsuba_threshold = 32;
+
+template <typename T>
+std::vector<T> schoolbook_multiply(const std::vector<T> &a, const std::vector<T> &b) {
+	std::vector<T> ret(a.size() + b.size() - 1, util<T>::zero(a[a.size() - 1]));
+	for (int i = 0; i < b.size(); i++) {
+		for (int j = 0; j < a.size(); j++) {
+			ret[i+j] += a[j]*b[i];
+		}
+	}
+	return ret;
+}
+
+template <typename T>
+std::vector<T> karatsuba_multiply(const std::vector<T> &a, const std::vector<T> &b) {
+	// Split a = a0 + x^m a1 and b = b0 + x^m b1; then
+	// ab = a0 b0 + x^m ((a0 + a1)(b0 + b1) - a0 b0 - a1 b1) + x^(2m) a1 b1,
+	// which costs three half-size products instead of four.
+	
+	if (a.size() < karatsuba_threshold || b.size() < karatsuba_threshold)
+		return schoolbook_multiply(a, b);
+	
+	T zero = util<T>::zero(a[a.size() - 1]);
+	std::vector<T> ret(a.size() + b.size() - 1, zero);
+	int m = std::max(a.size(), b.size()) / 2;
+	
+	// If one operand is much shorter than the other, it doesn't split;
+	// just multiply it by both halves of the longer one.
+	if (a.size() <= m || b.size() <= m) {
+		const std::vector<T> &s = (a.size() <= m) ? a : b;
+		const std::vector<T> &l = (a.size() <= m) ? b : a;
+		std::vector<T> l0(l.begin(), l.begin() + m);
+		std::vector<T> l1(l.begin() + m, l.end());
+		std::vector<T> z0 = karatsuba_multiply(s, l0);
+		std::vector<T> z1 = karatsuba_multiply(s, l1);
+		for (int i = 0; i < z0.size(); i++)
+			ret[i] += z0[i];
+		for (int i = 0; i < z1.size(); i++)
+			ret[i+m] += z1[i];
+		return ret;
+	}
+	
+	std::vector<T> a0(a.begin(), a.begin() + m);
+	std::vector<T> a1(a.begin() + m, a.end());
+	std::vector<T> b0(b.begin(), b.begin() + m);
+	std::vector<T> b1(b.begin() + m, b.end());
+	
+	std::vector<T> as = a0;
+	as.resize(std::max(a0.size(), a1.size()), zero);
+	for (int i = 0; i < a1.size(); i++)
+		as[i] += a1[i];
+	std::vector<T> bs = b0;
+	bs.resize(std::max(b0.size(), b1.size()), zero);
+	for (int i = 0; i < b1.size(); i++)
+		bs[i] += b1[i];
+	
+	std::vector<T> z0 = karatsuba_multiply(a0, b0);
+	std::vector<T> z2 = karatsuba_multiply(a1, b1);
+	std::vector<T> z1 = karatsuba_multiply(as, bs);
+	for (int i = 0; i < z0.size(); i++)
+		z1[i] -= z0[i];
+	for (int i = 0; i < z2.size(); i++)
+		z1[i] -= z2[i];
+	
+	for (int i = 0; i < z0.size(); i++)
+		ret[i] += z0[i];
+	// The top of z1 cancels out when a1 or b1 is shorter than m
+	for (int i = 0; i < z1.size() && i+m < ret.size(); i++)
+		ret[i+m] += z1[i];
+	for (int i = 0; i < z2.size(); i++)
+		ret[i+2*m] += z2[i];
+	return ret;
+}
+
 template <typename T>
 poly<T> poly<T>::operator*(const poly<T> &p) const {
 	if (this->coeffs.size() == 0)
 		return *this;
 	if (p.coeffs.size() == 0)
 		return p;
-	poly<T> ret = poly<T>();
-	for (int i = 0; i <= p.degree() + this->degree(); i++)
-		ret.coeffs.push_back(util<T>::zero(this->coeffs[this->coeffs.size() - 1]));
-	for (int i = 0; i <= p.degree(); i++) {
-		for (int j = 0; j <= this->degree(); j++) {
-			ret.coeffs[i+j] += this->coeffs[j]*p.coeffs[i];
-		}
-	}
-	return ret;
+	return poly<T>(karatsuba_multiply(this->coeffs, p.coeffs));
 }
 
 template <typename T>
 poly<T> &poly<T>::operator*=(const poly<T> &p) {
 	*this = (*this) * p;
+	return *this;
 }
 
 template <typename T>
 poly<T> &poly<T>::operator<<=(unsigned int len) {
 	if (this->coeffs.size() == 0)
 		return *this;
-	for (int i = 0; i < len; i++)
-		this->coeffs.insert(this->coeffs.begin(), util<T>::zero(this->coeffs[0]));
+	this->coeffs.insert(this->coeffs.begin(), len, util<T>::zero(this->coeffs[0]));
 	return *this;
 }
 
 template <typename T>
 poly<T> &poly<T>::operator>>=(unsigned int len) {
-	if (this->coeffs.size() == 0)
-		return *this;
-	for (int i = 0; i < len; i++)
-		this->coeffs.erase(this->coeffs.begin());
+	if (len >= this->coeffs.size())
+		this->coeffs.clear();
+	else
+		this->coeffs.erase(this->coeffs.begin(), this->coeffs.begin() + len);
 	return *this;
 } 
 
@@ -467,11 +556,13 @@ poly<T> poly<T>::operator%(const poly<T> &p) const {
 template <typename T>
 poly<T> &poly<T>::operator/=(const poly<T> &p) {
 	*this = (*this) / p;
+	return *this;
 }
 
 template <typename T>
 poly<T> &poly<T>::operator%=(const poly<T> &p) {
 	*this = (*this) % p;
+	return *this;
 }
 
 template <typename T>
@@ -644,30 +735,114 @@ T poly<T>::leading() {
 
 template <typename T>
 poly<T> poly<T>::compose(poly<T> x) {
+	// Horner's rule, so this takes deg - 1 multiplications by x
+	// rather than recomputing every power of x from scratch
 	poly<T> result = util<poly<T>>::zero(x);
-	for (int i = 0; i <= this->degree(); i++) {
-		poly<T> term = this->coeffs[i];
-		for (int j = 0; j < i; j++)
-			term *= x;
-		result += term;
+	for (int i = this->degree(); i >= 0; i--) {
+		result *= x;
+		result += poly<T>(this->coeffs[i]);
 	}
 	
 	return result;
 }
 
 template <typename T>
-T poly<T>::evaluate(T x) {
-	T result = util<T>::zero(x);
-	for (int i = 0; i <= this->degree(); i++) {
-		T term = this->coeffs[i];
-		for (int j = 0; j < i; j++)
-			term *= x;
-		result += term;
+std::vector<T> taylor_shift_horner(std::vector<T> a, const T &k) {
+	// Repeated synthetic division by x - k, i.e. Horner's rule run n times.
+	// n(n + 1)/2 multiply-adds, and only additions when k is 1.
+	int n = a.size() - 1;
+	if (k == util<T>::one(k)) {
+		for (int i = 0; i < n; i++)
+			for (int j = n - 1; j >= i; j--)
+				a[j] += a[j + 1];
+		return a;
 	}
+	for (int i = 0; i < n; i++)
+		for (int j = n - 1; j >= i; j--)
+			a[j] += k*a[j + 1];
+	return a;
+}
+
+template <typename T>
+std::vector<T> taylor_shift_block(const std::vector<T> &a, int start, int level, const std::vector<std::vector<T>> &powers, const T &k) {
+	// Shifts the block a[start, start + 2^level), splitting it as
+	// low + x^half high so that the result is
+	// low(x + k) + (x + k)^half high(x + k), with powers[i] = (x + k)^(2^i)
+	int end = std::min((int) a.size(), start + (1 << level));
+	if (end - start < karatsuba_threshold)
+		return taylor_shift_horner(std::vector<T>(a.begin() + start, a.begin() + end), k);
 	
+	int half = 1 << (level - 1);
+	std::vector<T> low = taylor_shift_block(a, start, level - 1, powers, k);
+	if (start + half >= end)
+		return low;
+	std::vector<T> high = taylor_shift_block(a, start + half, level - 1, powers, k);
+	std::vector<T> result = karatsuba_multiply(high, powers[level - 1]);
+	for (int i = 0; i < low.size(); i++)
+		result[i] += low[i];
 	return result;
 }
 
+template <typename T>
+poly<T> poly<T>::taylor_shift(T k) const {
+	// Returns p(x + k). Small degrees use the Horner kernel; above
+	// karatsuba_threshold the divide-and-conquer split does the work in
+	// a few large multiplications instead of O(n^2) small ones.
+	if (this->coeffs.size() < karatsuba_threshold)
+		return poly<T>(taylor_shift_horner(this->coeffs, k));
+	
+	std::vector<std::vector<T>> powers;
+	powers.push_back({k, util<T>::one(k)});
+	while ((1 << powers.size()) < this->coeffs.size())
+		powers.push_back(karatsuba_multiply(powers.back(), powers.back()));
+	
+	return poly<T>(taylor_shift_block(this->coeffs, 0, powers.size(), powers, k));
+}
+
+template <typename T>
+T poly<T>::evaluate(T x) const {
+	// Horner's rule
+	T result = util<T>::zero(x);
+	for (int i = this->degree(); i >= 0; i--)
+		multiply_add(result, x, this->coeffs[i]);
+	
+	return result;
+}
+
+template <typename T>
+std::pair<T, T> poly<T>::evaluate_with_derivative(T x) const {
+	// Returns (p(x), p'(x)), running Horner's rule for p' alongside the one
+	// for p, so Newton's method needs a single pass over the coefficients
+	T value = util<T>::zero(x);
+	T slope = util<T>::zero(x);
+	for (int i = this->degree(); i >= 0; i--) {
+		multiply_add(slope, x, value);
+		multiply_add(value, x, this->coeffs[i]);
+	}
+	
+	return std::make_pair(value, slope);
+}
+
+template <typename T>
+std::vector<T> poly<T>::evaluate_derivatives(T x, int k) const {
+	// Returns p(x), p'(x), ..., p^(k)(x). Repeated synthetic division by
+	// x - a gives the Taylor coefficients p^(j)(a)/j! in O(nk) operations.
+	std::vector<T> d(k + 1, util<T>::zero(x));
+	for (int i = this->degree(); i >= 0; i--) {
+		for (int j = std::min(k, this->degree() - i); j > 0; j--)
+			multiply_add(d[j], x, d[j - 1]);
+		multiply_add(d[0], x, this->coeffs[i]);
+	}
+	
+	T factorial = util<T>::one(x);
+	for (int j = 2; j <= k; j++) {
+		factorial *= util<T>::from_int(j, x);
+		d[j] *= factorial;
+	}
+	
+	return d;
+}
+
 template <typename T>
 poly<poly<T>> switch_variables(poly<poly<T>> orig) {
 	if (orig.degree() < 0)
@@ -676,4 +851,196 @@ poly<poly<T>> switch_variables(poly<poly<T>> orig) {
 	x <<= 1;
 	poly<poly<poly<T>>> mid = orig.convert(curried_convert(make_constant<T>()));
 	return mid.evaluate(poly<poly<T>>(x));
+}
+
+// Nodes of a subproduct tree covering at most this many points evaluate
+// their remainder directly by Horner's rule
+const int subproduct_leaf_size = 64;
+
+template <typename T>
+class subproduct_tree {
+	// The products of x - x_i over dyadic ranges of a fixed list of points,
+	// from the linear factors up to the product of all of them. Building
+	// the tree is most of the work, so one tree can evaluate any number of
+	// polynomials at the points, or interpolate values given at them.
+	// Level k, node i covers the points i 2^k up to (i + 1) 2^k - 1.
+	// Nodes of degree at least karatsuba_threshold also keep the inverse
+	// of their reversal mod x^(2^k), so that remainders take two products
+	// instead of a long division.
+	// Over C the reductions are numerically unstable: at 256 bits, a degree
+	// 160 polynomial evaluated at 150 points loses about 44 of its 77
+	// digits, so use it over exact rings such as ZN or with plenty of
+	// guard bits.
+	
+	private:
+		std::vector<T> points;
+		std::vector<std::vector<poly<T>>> levels;
+		std::vector<std::vector<poly<T>>> inverses;
+		std::vector<T> weights;
+		
+		static poly<T> truncate(const poly<T> &f, int k);
+		poly<T> remainder(const poly<T> &f, int level, int index) const;
+		void evaluate_node(const poly<T> &f, int level, int index, std::vector<T> &values) const;
+		poly<T> combine(const std::vector<T> &c, int level, int index) const;
+		
+	public:
+		subproduct_tree(std::vector<T> points);
+		
+		const std::vector<T> &get_points() const;
+		poly<T> get_product() const;
+		
+		std::vector<T> evaluate(const poly<T> &f) const;
+		poly<T> interpolate(const std::vector<T> &values);
+};
+
+template <typename T>
+subproduct_tree<T>::subproduct_tree(std::vector<T> points) {
+	this->points = std::move(points);
+	if (this->points.empty())
+		return;
+	
+	std::vector<poly<T>> leaves;
+	for (int i = 0; i < this->points.size(); i++)
+		leaves.push_back(poly<T>({-this->points[i], util<T>::one(this->points[i])}));
+	this->levels.push_back(leaves);
+	while (this->levels.back().size() > 1) {
+		const std::vector<poly<T>> &below = this->levels.back();
+		std::vector<poly<T>> level;
+		for (int i = 0; i < below.size(); i += 2)
+			level.push_back(i + 1 < below.size() ? below[i] * below[i + 1] : below[i]);
+		this->levels.push_back(level);
+	}
+	
+	// Newton iteration g <- g (2 - h g) for 1/h mod x^(2^k), h = rev(m)
+	for (int k = 0; k < this->levels.size(); k++) {
+		std::vector<poly<T>> level_inverses;
+		for (int i = 0; i < this->levels[k].size(); i++) {
+			poly<T> m = this->levels[k][i];
+			if (m.degree() < karatsuba_threshold) {
+				level_inverses.push_back(poly<T>());
+				continue;
+			}
+			poly<T> h = m.reverse();
+			poly<T> g = poly<T>(util<T>::one(this->points[0]));
+			poly<T> two = poly<T>(util<T>::from_int(2, this->points[0]));
+			for (int precision = 1; precision < (1 << k); ) {
+				precision = std::min(2*precision, 1 << k);
+				g = truncate(g * (two - truncate(truncate(h, precision) * g, precision)), precision);
+			}
+			level_inverses.push_back(g);
+		}
+		this->inverses.push_back(level_inverses);
+	}
+}
+
+template <typename T>
+const std::vector<T> &subproduct_tree<T>::get_points() const {
+	return this->points;
+}
+
+template <typename T>
+poly<T> subproduct_tree<T>::get_product() const {
+	if (this->levels.empty())
+		return poly<T>();
+	return this->levels.back()[0];
+}
+
+template <typename T>
+poly<T> subproduct_tree<T>::truncate(const poly<T> &f, int k) {
+	// f mod x^k
+	std::vector<T> coeffs;
+	for (int i = 0; i < k && i <= f.degree(); i++)
+		coeffs.push_back(f[i]);
+	return poly<T>(coeffs);
+}
+
+template <typename T>
+poly<T> subproduct_tree<T>::remainder(const poly<T> &f, int level, int index) const {
+	// With m monic of degree d and deg f = d + l - 1, the quotient is
+	// rev(rev(f) / rev(m) mod x^l), as long as l is within the stored
+	// precision.
+	
+	const poly<T> &m = this->levels[level][index];
+	int d = m.degree();
+	if (f.degree() < d)
+		return f;
+	int l = f.degree() - d + 1;
+	if (m.degree() < karatsuba_threshold || l > (1 << level))
+		return f.divide(m).remainder;
+	
+	poly<T> f_copy = f;
+	poly<T> q_rev = truncate(truncate(f_copy.reverse(), l) * this->inverses[level][index], l);
+	std::vector<T> q_coeffs(l, util<T>::zero(this->points[0]));
+	for (int i = 0; i <= q_rev.degree(); i++)
+		q_coeffs[l - 1 - i] = q_rev[i];
+	return truncate(f - poly<T>(q_coeffs) * m, d);
+}
+
+template <typename T>
+void subproduct_tree<T>::evaluate_node(const poly<T> &f, int level, int index, std::vector<T> &values) const {
+	int start = index << level;
+	int end = std::min<int>((index + 1) << level, this->points.size());
+	if (end - start <= subproduct_leaf_size) {
+		for (int i = start; i < end; i++)
+			values[i] = f.evaluate(this->points[i]);
+		return;
+	}
+	
+	for (int child = 2*index; child <= 2*index + 1 && child < this->levels[level - 1].size(); child++)
+		this->evaluate_node(this->remainder(f, level - 1, child), level - 1, child, values);
+}
+
+template <typename T>
+std::vector<T> subproduct_tree<T>::evaluate(const poly<T> &f) const {
+	// Reduces f down the tree, so that each point only sees a remainder
+	// of small degree
+	
+	std::vector<T> values(this->points);
+	if (this->points.empty())
+		return values;
+	
+	int top = this->levels.size() - 1;
+	poly<T> r = f;
+	if (r.degree() >= this->points.size())
+		r = r.divide(this->levels[top][0]).remainder;
+	this->evaluate_node(r, top, 0, values);
+	return values;
+}
+
+template <typename T>
+poly<T> subproduct_tree<T>::combine(const std::vector<T> &c, int level, int index) const {
+	// sum over the points x_i of node (level, index) of c_i times the
+	// product of the node's other linear factors
+	
+	if (level == 0)
+		return poly<T>(c[index]);
+	
+	poly<T> left = this->combine(c, level - 1, 2*index);
+	if (2*index + 1 >= this->levels[level - 1].size())
+		return left;
+	poly<T> right = this->combine(c, level - 1, 2*index + 1);
+	return left * this->levels[level - 1][2*index + 1] + right * this->levels[level - 1][2*index];
+}
+
+template <typename T>
+poly<T> subproduct_tree<T>::interpolate(const std::vector<T> &values) {
+	// Lagrange interpolation: with M the product of all x - x_i, the
+	// answer is sum values_i / M'(x_i) * M(x)/(x - x_i). T must be a field
+	// and the points distinct. The weights 1/M'(x_i) are kept for later
+	// calls.
+	
+	if (this->points.empty())
+		return poly<T>();
+	
+	if (this->weights.empty()) {
+		poly<T> m = this->get_product();
+		this->weights = this->evaluate(m.derivative());
+		for (int i = 0; i < this->weights.size(); i++)
+			this->weights[i] = util<T>::one(this->points[0]) / this->weights[i];
+	}
+	
+	std::vector<T> c;
+	for (int i = 0; i < this->points.size(); i++)
+		c.push_back(values[i] * this->weights[i]);
+	return this->combine(c, this->levels.size() - 1, 0);
 }
\ No newline at end of file
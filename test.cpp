@@ -3,6 +3,8 @@
 #include <gmpxx.h>
 #include <ctime>
 #include <cstdlib>
+#include <algorithm>
+#include <string>
 
 #include "polyring.h"
 #include "modring.h"
@@ -34,14 +36,211 @@ ZN_X prand(Z p, int deg, gmp_randstate_t state) {
 	return p1;
 }
 
+static int failures = 0;
+
+static void check(bool ok, const std::string &what) {
+	if (!ok) {
+		std::cout << "FAILED: " << what << std::endl;
+		failures++;
+	}
+}
+
+static void check_factors(Z_X u, std::vector<Z_X> expected, const std::string &what) {
+	// factor() returns the factors in no particular order, then the content
+	std::vector<Z_X> factors = factor(u);
+	check(factors.size() == expected.size() && std::is_permutation(factors.begin(), factors.end(), expected.begin()), what);
+}
+
+typedef poly<polymod<Q>> K_X;
+
+static K_X over_field(Q_X t, std::vector<Q_X> coeffs) {
+	// The polynomial with the given coefficients in Q[y]/(t(y))
+	std::vector<polymod<Q>> result;
+	for (int i = 0; i < coeffs.size(); i++)
+		result.push_back(polymod<Q>(t, coeffs[i]));
+	return K_X(result);
+}
+
+static void check_field_factors(std::vector<K_X> factors, std::vector<K_X> expected, const std::string &what) {
+	check(factors.size() == expected.size() && std::is_permutation(factors.begin(), factors.end(), expected.begin()), what);
+}
+
+static bool check_roots(Q_X p, const std::vector<C> &roots, int count, int precision) {
+	// Whether there are count roots, each of which a Newton step
+	// p(z)/p'(z) moves by less than 10^-precision
+	if (roots.size() != count)
+		return false;
+	for (int k = 0; k < roots.size(); k++) {
+		mp_bitcnt_t bits = roots[k].get_prec();
+		std::vector<C> coeffs;
+		for (int i = 0; i <= p.degree(); i++)
+			coeffs.push_back(C(R(p[i], bits)));
+		std::pair<C, C> v = C_X(coeffs).evaluate_with_derivative(roots[k]);
+		R step = sqrt((v.first / v.second).norm()), limit(1, bits);
+		for (int i = 0; i < precision; i++)
+			limit /= 10;
+		if (step >= limit)
+			return false;
+	}
+	return true;
+}
+
 int main(int argc, char *argv[]) {
 	mpf_set_default_prec(1000);
 	
+	// x^4 + 4 = (x^2 + 2x + 2)(x^2 - 2x + 2), a binomial whose cyclotomic
+	// piece is the whole polynomial in x^2
+	check_factors(Z_X({4, 0, 0, 0, 1}), {Z_X({2, 2, 1}), Z_X({2, -2, 1}), Z_X(1)}, "factor x^4 + 4");
+	check_factors(Z_X({9, 0, 0, 0, 1}), {Z_X({9, 0, 0, 0, 1}), Z_X(1)}, "factor x^4 + 9");
+	check_factors(Z_X({1, 0, 0, 0, 4}), {Z_X({1, 2, 2}), Z_X({1, -2, 2}), Z_X(1)}, "factor 4x^4 + 1");
+	
+	// Irreducible by Capelli's criterion, without any search mod p
+	std::vector<Z> x60_minus_2(61, 0);
+	x60_minus_2[0] = -2;
+	x60_minus_2[60] = 1;
+	check_factors(Z_X(x60_minus_2), {Z_X(x60_minus_2), Z_X(1)}, "factor x^60 - 2");
+	
+	// Repeated factors come out once per multiplicity, and the content
+	// keeps the sign of the leading coefficient
+	Z_X x_minus_1({-1, 1}), x_plus_2({2, 1});
+	check_factors(Z_X(-2) * x_minus_1 * x_minus_1 * x_plus_2 * x_plus_2 * x_plus_2,
+		{x_minus_1, x_minus_1, x_plus_2, x_plus_2, x_plus_2, Z_X(-2)}, "factor -2 (x - 1)^2 (x + 2)^3");
+	
+	// Rational roots, including one with a non-unit denominator
+	Z_X two_x_minus_3({-3, 2}), x_plus_5({5, 1}), x2_plus_1({1, 0, 1});
+	check_factors(two_x_minus_3 * x_plus_5 * x2_plus_1, {two_x_minus_3, x_plus_5, x2_plus_1, Z_X(1)}, "factor (2x - 3)(x + 5)(x^2 + 1)");
+	
+	// Cyclotomic factors of a polynomial that isn't a binomial
+	Z_X phi3 = cyclotomic(3), phi5 = cyclotomic(5), x3_minus_x_minus_1({-1, -1, 0, 1});
+	check_factors(phi3 * phi5 * x3_minus_x_minus_1, {phi3, phi5, x3_minus_x_minus_1, Z_X(1)}, "factor Phi_3 Phi_5 (x^3 - x - 1)");
+	check_factors(Z_X({64, 0, 0, 0, 0, 0, 1}), {Z_X({4, 0, 1}), Z_X({16, 0, -4, 0, 1}), Z_X(1)}, "factor x^6 + 64");
+	
+	// g(h) for g = (y - 1)(y + 3) and h = x^3 + 2x + 3, so the factors are
+	// h - 1 and h + 3
+	Z_X h({3, 2, 0, 1});
+	check_factors((h - Z_X(1)) * (h + Z_X(3)), {Z_X({2, 2, 0, 1}), Z_X({6, 2, 0, 1}), Z_X(1)}, "factor (h - 1)(h + 3) for h = x^3 + 2x + 3");
+	
+	// Over Q(a) with a^2 = 2, (x^2 - 2)(x^2 - 3) = (x - a)(x + a)(x^2 - 3)
+	Q_X t2({-2, 0, 1}), a({0, 1});
+	K_X x2_minus_2 = over_field(t2, {Q_X(-2), Q_X(0), Q_X(1)}), x2_minus_3 = over_field(t2, {Q_X(-3), Q_X(0), Q_X(1)});
+	std::vector<K_X> sqrt2_factors({over_field(t2, {-a, Q_X(1)}), over_field(t2, {a, Q_X(1)}), x2_minus_3});
+	check_field_factors(factor_squarefree<Q>(x2_minus_2 * x2_minus_3), sqrt2_factors, "Trager factor (x^2 - 2)(x^2 - 3) over Q(sqrt 2)");
+	check_field_factors(factor_squarefree(x2_minus_2 * x2_minus_3), sqrt2_factors, "p-adic factor (x^2 - 2)(x^2 - 3) over Q(sqrt 2)");
+	
+	// Squaring in place over non-monic quadratic moduli, whose integral
+	// forms are 3y^2 - 2 and 20y^2 + 6y + 9
+	std::vector<Q_X> quadratic_moduli({Q_X({-2, 0, 3}), Q_X({Q(3, 4), Q(1, 2), Q(5, 3)})});
+	for (int i = 0; i < quadratic_moduli.size(); i++) {
+		Q_X value({Q(2, 7), Q(-5, 3)});
+		polymod<Q> square(quadratic_moduli[i], value);
+		square *= square;
+		check(square == polymod<Q>(quadratic_moduli[i], value * value), "polymod<Q> x *= x over a non-monic quadratic modulus");
+	}
+	
+	// All derivatives at a rational point, past the degree where they vanish
+	Q_X quartic({3, -2, 0, 5, Q(1, 2)}), derivative = quartic;
+	std::vector<Q> derivatives = quartic.evaluate_derivatives(Q(-3, 7), 6);
+	bool derivatives_match = (derivatives.size() == 7);
+	for (int j = 0; derivatives_match && j <= 6; j++) {
+		derivatives_match = (derivatives[j] == derivative.evaluate(Q(-3, 7)));
+		derivative = derivative.derivative();
+	}
+	check(derivatives_match, "evaluate_derivatives matches repeated derivatives of a quartic");
+	
+	// The real roots of (x^2 - 2)(2x - 1) are -sqrt 2, 1/2 and sqrt 2.
+	// Refining hits 1/2 at a midpoint, which is then reported exactly.
+	Z_X real_roots_case = Z_X({-2, 0, 1}) * Z_X({-1, 2});
+	std::vector<real_root_interval> intervals = isolate_real_roots(real_roots_case);
+	check(intervals.size() == 3, "isolate_real_roots finds 3 roots of (x^2 - 2)(2x - 1)");
+	if (intervals.size() == 3) {
+		real_root_interval middle = refine_real_root(real_roots_case, intervals[1], Q(1, 1000));
+		check(middle.lower == Q(1, 2) && middle.upper == Q(1, 2), "refine_real_root finds 1/2 exactly");
+		real_root_interval low = refine_real_root(real_roots_case, intervals[0], Q(1, 1000));
+		real_root_interval high = refine_real_root(real_roots_case, intervals[2], Q(1, 1000));
+		check(high.upper - high.lower <= Q(1, 1000) && high.lower*high.lower < 2 && high.upper*high.upper > 2 && high.lower > 0,
+			"refine_real_root narrows sqrt 2");
+		check(low.upper - low.lower <= Q(1, 1000) && low.lower*low.lower > 2 && low.upper*low.upper < 2 && low.upper < 0,
+			"refine_real_root narrows -sqrt 2");
+	}
+	check(isolate_real_roots(Z_X({1, 0, 1})).empty(), "isolate_real_roots finds no roots of x^2 + 1");
+	intervals = isolate_real_roots(Z_X({0, -1, 0, 1}));
+	check(intervals.size() == 3 && intervals[1].lower == 0 && intervals[1].upper == 0, "isolate_real_roots finds the root 0 of x^3 - x exactly");
+	
+	// Multipoint evaluation mod p at more than subproduct_leaf_size points,
+	// so that nodes of degree at least karatsuba_threshold reduce through
+	// their Newton inverses
+	Z prime = 1000003;
+	std::vector<ZN> tree_points;
+	for (int i = 0; i < 150; i++)
+		tree_points.push_back(ZN(prime, 3*i + 1));
+	std::vector<Z> tree_coeffs;
+	for (int i = 0; i <= 160; i++)
+		tree_coeffs.push_back(7*i*i + 5*i + 2);
+	ZN_X tree_f = Z_X(tree_coeffs).convert(to_mod(prime));
+	subproduct_tree<ZN> tree(tree_points);
+	std::vector<ZN> tree_values = tree.evaluate(tree_f);
+	bool tree_matches = (tree_values.size() == tree_points.size());
+	for (int i = 0; tree_matches && i < tree_points.size(); i++)
+		tree_matches = (tree_values[i] == tree_f.evaluate(tree_points[i]));
+	check(tree_matches, "subproduct_tree<ZN> evaluates a degree 160 polynomial at 150 points");
+	
+	// Interpolation gives back f mod the product of x - x_i, and the second
+	// call reuses the weights kept by the first
+	check(tree.interpolate(tree_values) == tree_f % tree.get_product(), "subproduct_tree<ZN> interpolates f mod the product");
+	ZN_X tree_g = Z_X(std::vector<Z>(tree_coeffs.begin(), tree_coeffs.begin() + 100)).convert(to_mod(prime));
+	check(tree.interpolate(tree.evaluate(tree_g)) == tree_g, "subproduct_tree<ZN> interpolates again with cached weights");
+	
+	// Aberth on a Wilkinson-type product, on x^16 - 1, and on x^2 - 2 10^400,
+	// whose constant term doesn't fit in a double so that the iteration
+	// starts in mpf
+	Q_X wilkinson(1);
+	for (int i = 1; i <= 20; i++)
+		wilkinson = wilkinson * Q_X({-i, 1});
+	check(check_roots(wilkinson, find_complex_roots_aberth(wilkinson, 30), 20, 30), "find_complex_roots_aberth on (x - 1)...(x - 20)");
+	std::vector<Q> x16_minus_1(17, 0);
+	x16_minus_1[0] = -1;
+	x16_minus_1[16] = 1;
+	check(check_roots(Q_X(x16_minus_1), find_complex_roots_aberth(Q_X(x16_minus_1), 30), 16, 30), "find_complex_roots_aberth on x^16 - 1");
+	Z ten_400;
+	mpz_ui_pow_ui(ten_400.get_mpz_t(), 10, 400);
+	Q_X beyond_double({-2*ten_400, 0, 1});
+	check(check_roots(beyond_double, find_complex_roots_aberth(beyond_double, 30), 2, 30), "find_complex_roots_aberth on x^2 - 2 10^400");
+	
+	// Asking for more digits than 200 bits carry keeps the corrections from
+	// ever getting small enough, so the roots come from the Newton fallback
+	check(check_roots(Q_X({-2, 0, 1}), find_complex_roots_aberth(Q_X({-2, 0, 1}), 100, precision_context(200)), 2, 50),
+		"find_complex_roots_aberth falls back to Newton");
+	
+	// An explicit precision_context wins over a low mpf default, both when
+	// the roots are polished from doubles and when x^2 + 10^-400 x - 2, whose
+	// middle coefficient underflows a double, is done in mpf throughout
+	mpf_set_default_prec(64);
+	Q_X underflow({-2, Q(1, ten_400), 1});
+	std::vector<std::pair<Q_X, mp_bitcnt_t>> context_cases({{Q_X({-2, 0, 1}), 256}, {underflow, 512}});
+	for (int i = 0; i < context_cases.size(); i++) {
+		mp_bitcnt_t bits = context_cases[i].second;
+		std::vector<C> context_roots = find_complex_roots(context_cases[i].first, 60, precision_context(bits));
+		bool enough_bits = true;
+		for (int k = 0; k < context_roots.size(); k++)
+			enough_bits = enough_bits && context_roots[k].get_prec() >= bits;
+		check(enough_bits && check_roots(context_cases[i].first, context_roots, 2, 60), "find_complex_roots at a context's precision over a low mpf default");
+	}
+	mpf_set_default_prec(1000);
+	
+	// The batch overload splits 8 threads over 4 polynomials, 2 each for
+	// polishing, and must agree with one call per polynomial
+	std::vector<Q_X> batch({wilkinson, Q_X(x16_minus_1), Q_X({-2, 0, 1}), underflow});
+	std::vector<std::vector<C>> batch_roots = find_complex_roots(batch, 50, 8);
+	bool batch_matches = (batch_roots.size() == batch.size());
+	for (int i = 0; batch_matches && i < batch.size(); i++)
+		batch_matches = (batch_roots[i] == find_complex_roots(batch[i], 50));
+	check(batch_matches, "find_complex_roots on a batch with 8 threads");
+	
 	Q_X p({Q("-10000000000000000000000000000000000000001/10000000000000000000000000000000000000000 "), Q("-999999999999999999970000000000000000000099999999999999999999/10000000000000000000000000000000000000000"), Q("299999999999999999996999999999999999999999999999999999999999999999999999999999999/1000000000000000000000000000000000000000000000000000000000000"), Q("-299999999999999999998999999999999999999969999999999999999999999999999999999999999/1000000000000000000000000000000000000000000000000000000000000"), Q("9999999999999999999999999999999999999997/100000000000000000000"), Q("1/100000000000000000000")});
 	std::vector<C> roots = find_complex_roots(p, 50);
 	
 	for (int i = 0; i < roots.size(); i++)
 		std::cout << roots[i] << std::endl;
 
-	return 0;
+	return failures > 0;
 }
\ No newline at end of file